@@ -0,0 +1,26 @@
+#!/bin/sh
+
+EXECUTABLE=./bin/jazzinsea
+
+fen=${1:-board_fen/starting}
+depth=${2:-8}
+sizes=${3:-"16 64 256 1024 4096 16384"}
+
+echo "benchmarking '$fen' with depth $depth"
+
+for size in $sizes; do
+    start=$(date +%s%N)
+    result=$($EXECUTABLE -sn -d % -H "$size" \
+                         "loadfen -f '$fen'" \
+                         "aitime 1000000" \
+                         "aidepth $depth" \
+                         "evaluate" \
+                 2>&1)
+    end=$(date +%s%N)
+
+    mapped=$(echo "$result" | grep "measure: mapped" | cut -d' ' -f8- | tr -d .)
+    took=$(echo "$result" | grep "measure: took" | cut -d' ' -f3)
+    total=$(( (end - start) / 1000 ))
+
+    echo "size: $size MB, mapped $mapped, first move took: $took, total: ${total}us"
+done
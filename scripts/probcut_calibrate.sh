@@ -0,0 +1,70 @@
+#!/bin/sh
+
+# Collect the evaluations of random positions with a shallow and a deep
+# search, and print how much the deep evaluation differs from the shallow one.
+# The standard deviation is used to calibrate the ProbCut margins.
+
+EXECUTABLE=./bin/jazzinsea
+
+reduction=${1:-4}
+depths=${2:-"5 6 7 8"}
+samples=${3:-20}
+plies=${4:-8}
+
+evaluation() {
+    fen="$1"
+    depth="$2"
+
+    $EXECUTABLE -sn \
+                "loadfen '$fen'" \
+                "aitime 1000000" \
+                "aidepth $depth" \
+                "evaluate -e" \
+                2>&1
+}
+
+echo "calibrating with reduction $reduction, $samples samples of $plies random plies"
+
+positions=""
+sample=0
+while [ $sample -lt $samples ]; do
+    fen=$(cat board_fen/starting)
+
+    ply=0
+    while [ $ply -lt $plies ]; do
+        moves=$($EXECUTABLE -sn "loadfen '$fen'" "allmoves" 2>&1 |
+                    tr -d '{},' | tr ' ' '\n' | grep -v '^$')
+        [ -z "$moves" ] && break
+
+        move=$(echo "$moves" | shuf -n 1)
+        fen=$($EXECUTABLE -sn "loadfen '$fen'" "makemove $move" "savefen" 2>&1)
+        ply=$((ply + 1))
+    done
+
+    positions="$positions$fen
+"
+    sample=$((sample + 1))
+done
+
+for depth in $depths; do
+    shallow_depth=$((depth - reduction))
+
+    echo "$positions" | grep -v '^$' | while read -r fen; do
+        shallow=$(evaluation "$fen" $shallow_depth)
+        deep=$(evaluation "$fen" $depth)
+
+        # Mates do not tell anything about the error of the evaluation.
+        case "$shallow$deep" in
+            *M*) continue ;;
+        esac
+
+        echo "$shallow $deep"
+    done | awk -v depth=$depth '
+        { diff = $2 - $1; n++; sum += diff; sum2 += diff * diff }
+        END {
+            if (!n) { print "depth " depth ": no samples"; exit }
+            mean = sum / n
+            printf "depth %d: %d samples, mean %.1f, deviation %.1f\n",
+                   depth, n, mean, sqrt(sum2 / n - mean * mean)
+        }'
+done
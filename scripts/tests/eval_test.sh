@@ -2,16 +2,21 @@
 
 EXECUTABLE=./bin/jazzinsea
 
+# The arguments after the expected evaluation are run as commands before the
+# evaluation.
 eval_check() {
+    name="$1"
     path="board_fen/$1"
     depth="$2"
     eval="$3"
+    shift 3
 
-    echo -e "[    ] testing for '$1', fen: '$(cat $path)' with depth $depth -> '$eval'"
+    echo -e "[    ] testing for '$name', fen: '$(cat $path)' with depth $depth $* -> '$eval'"
 
     got=$($EXECUTABLE -sn \
                       "loadfen -f '$path'" \
                       "aidepth $depth" \
+                      "$@" \
                       "evaluate -e" \
                       2>&1)
     exit=$?
@@ -39,6 +44,46 @@ eval_check() {
     echo -e "\e[1;32m\e[F\e[CDONE\e[0m"
 }
 
+solve_check() {
+    path="board_fen/$1"
+    depth="$2"
+    eval="$3"
+
+    echo -e "[    ] solving '$1', fen: '$(cat $path)' with depth $depth -> '$eval'"
+
+    got=$($EXECUTABLE -sn \
+                      "loadfen -f '$path'" \
+                      "aitime 60000" \
+                      "solve $depth" \
+                      2>&1)
+    exit=$?
+
+    if [ "$exit" != 0 ]; then
+        echo -e "\e[1;31m\e[F\e[CERR\e[0m"
+
+        >&2 echo -e "\e[1;31m"
+        >&2 echo -e "jazz exit with exit code $exit"
+        >&2 echo -e "$got"
+        >&2 echo -e "\e[0m"
+        return
+    fi
+
+    # Only check the mate distance, not the moves.
+    got="${got##* -> }"
+
+    if [ "$got" != "$eval" ]; then
+        echo -e "\e[1;31m\e[F\e[CERR\e[0m"
+
+        >&2 echo -en "\e[1;31m"
+        >&2 echo -e "error: did not pass solve test:"
+        >&2 echo -e "error: for depth $depth, got $got expected $eval"
+        >&2 echo -en "\e[0m"
+        return
+    fi
+
+    echo -e "\e[1;32m\e[F\e[CDONE\e[0m"
+}
+
 echo "testing for evaluation..."
 
 eval_check mate_test_2 8  WM#8
@@ -53,3 +98,20 @@ eval_check mate_test_4 12 WM#11
 eval_check mate_test_4 13 WM#11
 
 eval_check mate_test_5 13 BM#12
+
+echo "testing for parallel evaluation..."
+
+for mode in lazy split; do
+    eval_check mate_test_2 11 WM#8 "aithreads 4" "aiparallel $mode"
+    eval_check mate_test_4 13 WM#11 "aithreads 4" "aiparallel $mode"
+    eval_check mate_test_5 13 BM#12 "aithreads 4" "aiparallel $mode"
+done
+
+echo "testing for solving..."
+
+solve_check mate_test_2 11 WM#8
+solve_check mate_test_3 12 WM#12
+solve_check mate_test_3 14 WM#12
+solve_check mate_test_4 13 WM#11
+solve_check mate_test_5 13 BM#12
+solve_check mate_test_5 11 "no mate in 11 plies"
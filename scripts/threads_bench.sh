@@ -0,0 +1,27 @@
+#!/bin/sh
+
+EXECUTABLE=./bin/jazzinsea
+
+fen=${1:-board_fen/starting}
+depth=${2:-8}
+threads=${3:-"1 2 4 8 16 32 64"}
+mode=${4:-lazy}
+
+echo "benchmarking '$fen' with depth $depth in $mode mode"
+
+for count in $threads; do
+    result=$($EXECUTABLE -sn -d % \
+                         "loadfen -f '$fen'" \
+                         "aitime 1000000" \
+                         "aidepth $depth" \
+                         "aithreads $count" \
+                         "aiparallel $mode" \
+                         "evaluate" \
+                 2>&1)
+
+    took=$(echo "$result" | grep "measure: took" | cut -d' ' -f3)
+    nodes=$(echo "$result" | grep "measure: called _evaluate" | cut -d' ' -f4)
+    nps=$(echo "$result" | grep "nodes per second" | cut -d' ' -f3)
+
+    echo "threads: $count, took: $took, nodes: $nodes, nodes per second: $nps"
+done
@@ -15,8 +15,11 @@ JazzInSea. If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include "ai/cache.h"
+#include "ai/transposition_table.h"
 #include "board/pos_t.h"
 
+#include <math.h>
+
 void setup_cache(ai_cache_t *cache, const int topleft_pawn[4][4],
                  const int topleft_knight[4][4],
                  const int topleft_pawn_centered[4][4],
@@ -24,7 +27,10 @@ void setup_cache(ai_cache_t *cache, const int topleft_pawn[4][4],
                  const int topleft_pawn_island[4][4],
                  const int topleft_knight_island[4][4]) {
 
+  cache->stop_search = NULL;
   cache->cancel_search = false;
+  cache->stop_poll_interval = 1024;
+  cache->stop_poll_count = 0;
 
   // Load the advantage tables.
   for (int row = 0; row < 8; row++) {
@@ -60,19 +66,107 @@ void setup_cache(ai_cache_t *cache, const int topleft_pawn[4][4],
   cache->est_evaluation_pos = 1;
   cache->est_evaluation_old = 10;
   cache->est_evaluation_killer = 50;
+  cache->est_evaluation_countermove = 30;
+  cache->est_evaluation_history = 40;
 
   cache->late_move_reduction = 8;
   cache->late_move_min_depth = 3;
-  cache->exchange_deepening = 2;
-
-  cache->tt_size = 0x200000;
+  cache->late_move_reduction_divisor = 225;
+  cache->late_move_history_threshold = HISTORY_SCORE_MAX / 4;
+
+  for (size_t depth = 0; depth < LMR_DEPTHS; depth++) {
+    for (size_t index = 0; index < LMR_MOVES; index++) {
+      double reduction = depth && index ? log(depth) * log(index) * 100 /
+                                              cache->late_move_reduction_divisor
+                                        : 0;
+      cache->late_move_reductions[depth][index] = (uint8_t)(reduction + 0.5);
+    }
+  }
 
-  cache->transposition_table = malloc(sizeof(tt_entry_t) * cache->tt_size);
+  cache->futility_margin = 300;
+  cache->razoring_margin[0] = 400;
+  cache->razoring_margin[1] = 800;
+  cache->late_move_pruning_max_depth = 3;
+  cache->late_move_pruning_count[1] = 8;
+  cache->late_move_pruning_count[2] = 12;
+  cache->late_move_pruning_count[3] = 18;
+
+  // Margins are one and a half times the standard deviation between the
+  // evaluations of depth d - 4 and depth d, measured with
+  // scripts/probcut_calibrate.sh.
+  cache->probcut_min_depth = 5;
+  cache->probcut_reduction = 4;
+  cache->probcut_margin[5] = 350;
+  cache->probcut_margin[6] = 500;
+  cache->probcut_margin[7] = 530;
+  cache->probcut_margin[8] = 440;
+  cache->probcut_margin[9] = 440;
+
+  cache->iid_min_depth = 5;
+  cache->iid_reduction = 2;
+
+  cache->multi_cut_min_depth = 6;
+  cache->multi_cut_reduction = 3;
+  cache->multi_cut_moves = 6;
+  cache->multi_cut_count = 0;
+
+  cache->null_move_reduction = 2;
+  cache->null_move_min_depth = 4;
+  cache->null_move_min_pieces = 4;
+
+  cache->lone_solver_max_depth = 8;
+
+  cache->quiescence_max_depth = 16;
+
+  cache->aspiration_window = 100;
+  cache->aspiration_widening = 4;
+  cache->aspiration_min_depth = 3;
+
+  cache->split_min_depth = 4;
+  cache->split_pool = NULL;
+  cache->split_point = NULL;
+
+  start_unmanaged_time_manager(&cache->time_manager);
+  cache->time_default_branching = 4;
+  cache->time_min_measured_ms = 5;
+  cache->time_stable_iterations = 4;
+  cache->time_stable_percent = 50;
+
+  cache->ponder_prediction_depth = 6;
+
+  cache->mcts_tree = NULL;
+  cache->mcts_pool_size = 0x100000;
+  cache->mcts_exploration = 140;
+  cache->mcts_expand_visits = 16;
+  cache->mcts_virtual_loss = 3;
+  cache->mcts_playout_depth = 8;
+  cache->mcts_draw_margin = 200;
+  cache->mcts_eval_scale = 1000;
+  cache->mcts_random = 1;
+
+  cache->search_stack = NULL;
+  cache->search_stack_size = 0;
+  cache->search_stack_capacity = 0;
+
+  for (size_t ply = 0; ply < KILLER_PLIES; ply++) {
+    cache->killer_moves[ply][0] = MOVE_INV;
+    cache->killer_moves[ply][1] = MOVE_INV;
+  }
 
-  // Depth < 0 on a memorized item indicates not set.
-  for (size_t i = 0; i < cache->tt_size; i++) {
-    cache->transposition_table[i] = (tt_entry_t){.eval = EVAL_INVALID};
+  for (int color = 0; color < 2; color++) {
+    for (pos_t from = 0; from < 64; from++) {
+      for (pos_t to = 0; to < 64; to++) {
+        cache->history_scores[color][from][to] = 0;
+        cache->countermoves[color][from][to] = MOVE_INV;
+      }
+    }
   }
+
+  cache->tt_generation = 0;
+  cache->tt_age_depth = 4;
+  cache->tt_bucket_count = 0;
+  cache->tt_mapped_size = 0;
+  cache->transposition_table = NULL;
 }
 
-void free_cache(ai_cache_t *cache) { free(cache->transposition_table); }
+void free_cache(ai_cache_t *cache) { free_transposition_table(cache); }
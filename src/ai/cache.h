@@ -18,20 +18,64 @@ JazzInSea. If not, see <https://www.gnu.org/licenses/>.
 #define _AI_CACHE_H
 
 #include "ai/eval_t.h"
+#include "ai/mcts_tree.h"
+#include "ai/search_stack.h"
+#include "ai/split_point.h"
+#include "ai/time_manager.h"
 #include "board/hash_t.h"
+#include "move/move_t.h"
 #include <stddef.h>
+#include <stdint.h>
+
+#define PROBCUT_DEPTHS 10
+#define LMR_DEPTHS 64
+#define LMR_MOVES 64
+#define KILLER_PLIES 256
+#define HISTORY_SCORE_MAX 0x4000
+#define TT_BUCKET_ENTRIES 4
+#define TT_DEPTH_MAX 254
+#define TT_DEPTH_MATE 255
 
 typedef enum { EXACT, LOWER, UPPER } node_type_t;
 
+// An entry of the transposition table, packed into 16 bytes.
 typedef struct {
-  hash_t hash;
-  size_t depth;
+  // The low 32 bits of the board hash, xored with the rest of the entry. The
+  // high bits select the bucket.
+  uint32_t key;
+
   eval_t eval;
-  node_type_t node_type;
+
+  // The best move of the node, or the move that cut it. MOVE_INV if there is
+  // none.
+  move_t move;
+
+  // The depth of the search, at most TT_DEPTH_MAX. Mates are saved with
+  // TT_DEPTH_MATE, and empty entries have a depth of 0.
+  uint8_t depth;
+
+  // A node_type_t.
+  uint8_t node_type;
+
+  // The tt_generation of the search that saved the entry.
+  uint8_t generation;
 } tt_entry_t;
 
+// The entries that a board can be saved to, filling a cache line.
 typedef struct {
+  tt_entry_t entries[TT_BUCKET_ENTRIES];
+} __attribute__((aligned(64))) tt_bucket_t;
+
+typedef struct {
+  // Shared by all of the threads of a search, and set atomically to stop
+  // them.
+  bool *stop_search;
+
+  // Set once the thread saw stop_search. The shared flag is only read every
+  // stop_poll_interval nodes.
   bool cancel_search;
+  unsigned int stop_poll_interval;
+  unsigned int stop_poll_count;
 
   // Advantage tables used if there are no centered piece for a color.
   int pawn_adv_table[64];
@@ -52,15 +96,188 @@ typedef struct {
   int est_evaluation_pos;
   int est_evaluation_old;
   int est_evaluation_killer;
+  int est_evaluation_countermove;
 
+  // Added to the estimate of a move in proportion to its history score, up to
+  // this much at HISTORY_SCORE_MAX.
+  int est_evaluation_history;
+
+  // Moves after the first late_move_reduction moves of nodes at least
+  // late_move_min_depth deep are searched with
+  // late_move_reductions[depth][index] less plies first. The reductions grow
+  // with log(depth) * log(index) / late_move_reduction_divisor, where the
+  // divisor is in hundredths. Depths and indexes past the end of the table use
+  // the last entry.
   int late_move_reduction;
   int late_move_min_depth;
-  int exchange_deepening;
+  int late_move_reduction_divisor;
+  uint8_t late_move_reductions[LMR_DEPTHS][LMR_MOVES];
+
+  // Moves with at least this history score are reduced one ply less.
+  int late_move_history_threshold;
+
+  // Quiet moves at frontier nodes are pruned if they are worse than the bound
+  // by more than futility_margin.
+  int futility_margin;
+
+  // Nodes at depth 1 and 2 without captures that are worse than the bound by
+  // more than the margin of their depth fail with their static evaluation.
+  int razoring_margin[2];
+
+  // At depths up to late_move_pruning_max_depth, quiet moves after the first
+  // late_move_pruning_count[depth] moves are not searched.
+  size_t late_move_pruning_max_depth;
+  int late_move_pruning_count[4];
+
+  // ProbCut searches nodes at least probcut_min_depth deep with
+  // probcut_reduction less plies, on a bound probcut_margin[depth] beyond the
+  // current bound. Depths past the end of the table use the last margin.
+  size_t probcut_min_depth;
+  size_t probcut_reduction;
+  int probcut_margin[PROBCUT_DEPTHS];
+
+  // Nodes with an open window at least iid_min_depth deep and without a hash
+  // move are searched with iid_reduction less plies first, to find one.
+  size_t iid_min_depth;
+  size_t iid_reduction;
+
+  // Multi-cut searches the first multi_cut_moves moves with
+  // multi_cut_reduction less plies, and cuts the node if multi_cut_count of
+  // them pass the bound. Disabled if multi_cut_count is 0.
+  size_t multi_cut_min_depth;
+  size_t multi_cut_reduction;
+  size_t multi_cut_moves;
+  size_t multi_cut_count;
+
+  // Null move pruning searches the position after passing the turn with
+  // null_move_reduction less plies. It is only used on nodes at least
+  // null_move_min_depth deep, where both players have at least
+  // null_move_min_pieces pieces.
+  size_t null_move_reduction;
+  size_t null_move_min_depth;
+  unsigned int null_move_min_pieces;
+
+  // Inside the search, the lone piece solver looks for mates at most this many
+  // plies deep. The root is solved up to the full depth.
+  size_t lone_solver_max_depth;
+
+  // Quiescence search follows captures at most this many plies past the
+  // horizon.
+  size_t quiescence_max_depth;
+
+  // Iterative deepening searches with a window of this size around the
+  // evaluation of the last depth. The window is multiplied by
+  // aspiration_widening each time the evaluation falls outside of it.
+  int aspiration_window;
+  int aspiration_widening;
+  int aspiration_min_depth;
+
+  // Nodes shallower than this are never split between threads.
+  int split_min_depth;
 
-  size_t tt_size;
-  tt_entry_t *transposition_table;
+  // Pool of the split points, NULL if the search is not split between
+  // threads.
+  split_pool_t *split_pool;
+
+  // The innermost split point the thread is working on, NULL if none.
+  split_point_t *split_point;
+
+  // Time management of the main thread. The next depth is predicted to take
+  // the time of the last depth multiplied by the branching factor between the
+  // last two depths, or by time_default_branching if the depths took less than
+  // time_min_measured_ms. After the best move stayed the same for
+  // time_stable_iterations depths, only time_stable_percent of the soft limit
+  // is used.
+  time_manager_t time_manager;
+  size_t time_default_branching;
+  size_t time_min_measured_ms;
+  size_t time_stable_iterations;
+  size_t time_stable_percent;
+
+  // Depth of the search that predicts the reply of the opponent before
+  // pondering.
+  size_t ponder_prediction_depth;
+
+  // The tree shared by the threads, NULL if the search is not a Monte Carlo
+  // tree search.
+  mcts_tree_t *mcts_tree;
+
+  // Number of nodes preallocated for the Monte Carlo search tree.
+  size_t mcts_pool_size;
+
+  // Weight of the exploration term of UCT, in hundredths.
+  int mcts_exploration;
+
+  // Nodes other than the root are expanded after this many visits.
+  unsigned int mcts_expand_visits;
+
+  // Lost visits added to a node while a playout through it is running.
+  unsigned int mcts_virtual_loss;
+
+  // Playouts that did not end after this many random moves are won by the
+  // player whose position evaluation is better by more than mcts_draw_margin.
+  size_t mcts_playout_depth;
+  int mcts_draw_margin;
+
+  // Evaluation of a move that wins every playout.
+  int mcts_eval_scale;
+
+  // State of the random number generator of the playouts.
+  uint64_t mcts_random;
+
+  // The frames of the nodes the thread is searching. Every thread has its own
+  // stack.
+  search_frame_t *search_stack;
+  size_t search_stack_size;
+  size_t search_stack_capacity;
+
+  // The last two moves that cut a node, for every ply. Plies are counted from
+  // the start of the game, modulo KILLER_PLIES, so that the moves stay at their
+  // ply between the searches. The newer move is in the first slot.
+  move_t killer_moves[KILLER_PLIES][2];
+
+  // Butterfly history, the score of the moves that cut a node by color, from
+  // and to. A cut adds depth * depth, and all of the scores are halved when one
+  // of them reaches HISTORY_SCORE_MAX, and before every search.
+  int history_scores[2][64][64];
+
+  // The last move that cut a node after each move of the opponent, by color and
+  // the from and to of the move of the opponent.
+  move_t countermoves[2][64][64];
+
+  // Incremented for every search. When a board is saved to a full bucket, the
+  // entry with the least depth is replaced, counting every search since an
+  // entry was saved as tt_age_depth plies less.
+  uint8_t tt_generation;
+  int tt_age_depth;
+
+  // The table is mapped with setup_transposition_table, and shared by the
+  // copies of the cache. NULL until it is set up.
+  size_t tt_bucket_count;
+  size_t tt_mapped_size;
+  tt_bucket_t *transposition_table;
 } ai_cache_t;
 
+// Check if the search was stopped, reading the shared flag only every
+// stop_poll_interval calls.
+static inline bool is_search_canceled(ai_cache_t *cache) {
+  if (cache->cancel_search)
+    return true;
+
+  if (++cache->stop_poll_count < cache->stop_poll_interval)
+    return false;
+
+  cache->stop_poll_count = 0;
+  cache->cancel_search = __atomic_load_n(cache->stop_search, __ATOMIC_RELAXED);
+  return cache->cancel_search;
+}
+
+// Check if the search was stopped, reading the shared flag right away.
+static inline bool is_search_stopped(ai_cache_t *cache) {
+  return cache->cancel_search ||
+         __atomic_load_n(cache->stop_search, __ATOMIC_RELAXED);
+}
+
 void setup_cache(ai_cache_t *cache, const int[4][4], const int[4][4],
                  const int[4][4], const int[4][4], const int[4][4],
                  const int[4][4]);
@@ -0,0 +1,364 @@
+/*
+This file is part of JazzInSea.
+
+JazzInSea is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+JazzInSea is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+JazzInSea. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "ai/dfpn.h"
+#include "ai/eval_t.h"
+#include "ai/measure_count.h"
+#include "board/status_t.h"
+#include "io/pp.h"
+#include "move/generation.h"
+#include "move/make_move.h"
+#include "move/move_t.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Proof and disproof numbers are never bigger than this value. A node with a
+// proof number of DFPN_INFINITY is disproven, and a node with a disproof number
+// of DFPN_INFINITY is proven.
+#define DFPN_INFINITY (UINT32_MAX / 2)
+#define DFPN_TABLE_SIZE 0x40000
+#define DFPN_NO_WIN SIZE_MAX
+
+typedef struct {
+  hash_t hash;
+  uint32_t proof;
+  uint32_t disproof;
+  uint8_t depth;
+  bool turn;
+  bool attacker;
+} dfpn_entry_t;
+
+typedef struct {
+  bool *cancel_search;
+  bool canceled;
+
+  // Set once a draw by repetition is reached, until the node that started
+  // searching the draw returns.
+  bool repetition;
+
+  // Proof and disproof numbers of the searched positions.
+  dfpn_entry_t *table;
+} dfpn_solver_t;
+
+// A move of a node and the proof and disproof numbers of the position after it.
+typedef struct {
+  move_t move;
+  hash_t hash;
+  uint32_t proof;
+  uint32_t disproof;
+} dfpn_child_t;
+
+static inline uint32_t dfpn_add(uint32_t a, uint32_t b) {
+  return a + b >= DFPN_INFINITY ? DFPN_INFINITY : a + b;
+}
+
+static inline dfpn_entry_t *dfpn_entry(dfpn_solver_t *solver, hash_t hash) {
+  return &solver->table[hash % DFPN_TABLE_SIZE];
+}
+
+// Set the proof and disproof numbers of a position that was not searched.
+static inline void dfpn_load(dfpn_solver_t *solver, dfpn_child_t *child,
+                             bool turn, bool attacker, size_t depth) {
+  dfpn_entry_t *entry = dfpn_entry(solver, child->hash);
+
+  if (entry->hash == child->hash && entry->turn == turn &&
+      entry->attacker == attacker && entry->depth == depth) {
+    child->proof = entry->proof;
+    child->disproof = entry->disproof;
+  } else {
+    child->proof = 1;
+    child->disproof = 1;
+  }
+}
+
+static inline void dfpn_store(dfpn_solver_t *solver, hash_t hash, bool turn,
+                              bool attacker, size_t depth, uint32_t proof,
+                              uint32_t disproof) {
+  *dfpn_entry(solver, hash) = (dfpn_entry_t){
+      .hash = hash,
+      .proof = proof,
+      .disproof = disproof,
+      .depth = depth,
+      .turn = turn,
+      .attacker = attacker,
+  };
+}
+
+// Search the node until its proof number reaches proof_threshold or its
+// disproof number reaches disproof_threshold.
+// The attacker tries to win in at most depth plies. Positions that are not won
+// by then are disproven.
+// The table ignores how the position was reached, so the nodes whose search
+// reached a draw by repetition are not remembered.
+static void _dfpn_search(dfpn_solver_t *solver, board_state_t *state,
+                         history_t *history, bool attacker, size_t depth,
+                         uint32_t proof_threshold, uint32_t disproof_threshold,
+                         uint32_t *proof, uint32_t *disproof) {
+  if (__atomic_load_n(solver->cancel_search, __ATOMIC_RELAXED)) {
+    solver->canceled = true;
+    return;
+  }
+
+#ifdef MEASURE_EVAL_COUNT
+  measure_count.dfpn_count++;
+#endif
+
+  bool turn = state->turn;
+  bool attacker_turn = turn == attacker;
+
+  bool outer_repetition = solver->repetition;
+  solver->repetition = false;
+
+  move_t moves[256];
+  generate_moves(state, moves);
+
+  // Make all of the moves once, to find the game ends and the hash values of
+  // the children.
+  dfpn_child_t children[256];
+  size_t length = 0;
+  for (; is_valid_move(moves[length]); length++) {
+    dfpn_child_t *child = &children[length];
+    child->move = moves[length];
+
+    do_move(state, history, child->move);
+    child->hash = state->hash;
+
+    switch (state->status & 0x30) {
+    case 0x00:
+      // Positions that are not won at the end of the depth are disproven.
+      if (depth > 1) {
+        dfpn_load(solver, child, !turn, attacker, depth - 1);
+      } else {
+        child->proof = DFPN_INFINITY;
+        child->disproof = 0;
+      }
+      break;
+    case 0x20:
+    case 0x30:
+      if (((state->status & 0x30) == 0x20) == attacker) {
+        child->proof = 0;
+        child->disproof = DFPN_INFINITY;
+        break;
+      }
+      // fall through
+    case 0x10:
+      if (state->status == DRAW_BY_REPETITION)
+        solver->repetition = true;
+      child->proof = DFPN_INFINITY;
+      child->disproof = 0;
+      break;
+    }
+
+    undo_last_move(state, history);
+  }
+
+  while (true) {
+    // On attacker nodes, one proven child is enough to prove the node, and all
+    // of the children have to be disproven to disprove it. The opposite is
+    // true for the defender nodes.
+    uint32_t sum = 0;
+    uint32_t min = DFPN_INFINITY;
+    uint32_t second_min = DFPN_INFINITY;
+    size_t best = 0;
+
+    for (size_t i = 0; i < length; i++) {
+      uint32_t child_min =
+          attacker_turn ? children[i].proof : children[i].disproof;
+      uint32_t child_sum =
+          attacker_turn ? children[i].disproof : children[i].proof;
+
+      sum = dfpn_add(sum, child_sum);
+
+      if (child_min < min) {
+        second_min = min;
+        min = child_min;
+        best = i;
+      } else if (child_min < second_min) {
+        second_min = child_min;
+      }
+    }
+
+    // No moves is a draw.
+    if (!length) {
+      min = DFPN_INFINITY;
+      sum = 0;
+    }
+
+    *proof = attacker_turn ? min : sum;
+    *disproof = attacker_turn ? sum : min;
+
+    if (*proof >= proof_threshold || *disproof >= disproof_threshold)
+      break;
+
+    // Search the most promising child, until it is no longer the most
+    // promising one.
+    dfpn_child_t *child = &children[best];
+    uint32_t child_proof_threshold;
+    uint32_t child_disproof_threshold;
+
+    if (attacker_turn) {
+      child_proof_threshold = proof_threshold < second_min + 1
+                                  ? proof_threshold
+                                  : second_min + 1;
+      child_disproof_threshold =
+          dfpn_add(disproof_threshold - *disproof, child->disproof);
+    } else {
+      child_proof_threshold =
+          dfpn_add(proof_threshold - *proof, child->proof);
+      child_disproof_threshold = disproof_threshold < second_min + 1
+                                     ? disproof_threshold
+                                     : second_min + 1;
+    }
+
+    do_move(state, history, child->move);
+    _dfpn_search(solver, state, history, attacker, depth - 1,
+                 child_proof_threshold, child_disproof_threshold,
+                 &child->proof, &child->disproof);
+    undo_last_move(state, history);
+
+    if (solver->canceled)
+      return;
+  }
+
+  if (solver->repetition)
+    return;
+  solver->repetition = outer_repetition;
+
+  dfpn_store(solver, state->hash, turn, attacker, depth, *proof, *disproof);
+}
+
+// Check if the attacker can force a win in at most depth plies.
+static bool _dfpn_win(dfpn_solver_t *solver, board_state_t *state,
+                      history_t *history, bool attacker, size_t depth) {
+  switch (state->status & 0x30) {
+  case 0x10:
+    return false;
+  case 0x20:
+    return attacker;
+  case 0x30:
+    return !attacker;
+  }
+
+  if (!depth)
+    return false;
+
+  uint32_t proof;
+  uint32_t disproof;
+  _dfpn_search(solver, state, history, attacker, depth, DFPN_INFINITY,
+               DFPN_INFINITY, &proof, &disproof);
+
+  return !solver->canceled && !proof;
+}
+
+// Get the least number of plies the winner needs to win, at most max_depth.
+// Returns DFPN_NO_WIN if the winner can not force a win in max_depth plies.
+static size_t _dfpn_win_depth(dfpn_solver_t *solver, board_state_t *state,
+                              history_t *history, bool winner,
+                              size_t max_depth) {
+  for (size_t depth = 0; depth <= max_depth; depth++) {
+    if (_dfpn_win(solver, state, history, winner, depth))
+      return depth;
+  }
+
+  return DFPN_NO_WIN;
+}
+
+// Find the exact mate distance of a position with depth-first proof-number
+// search, and the moves that lead to it.
+// Every depth limit is proven or disproven for the side to move first, then
+// for the opponent. The first depth that is proven is the exact distance.
+// The winner plays the moves that win the fastest, and the loser plays the
+// moves that lose the slowest.
+// Returns EVAL_INVALID if neither player can force a win in max_depth plies,
+// or if the search is canceled.
+eval_t dfpn_solve(board_state_t *state, history_t *history,
+                  bool *cancel_search, size_t max_depth, move_t *best_moves) {
+  dfpn_solver_t solver = {
+      .cancel_search = cancel_search,
+      .canceled = false,
+      .repetition = false,
+      .table = calloc(DFPN_TABLE_SIZE, sizeof(dfpn_entry_t)),
+  };
+
+  if (!solver.table) {
+    io_error();
+    pp_f("error: could not allocate the proof table\n");
+    return EVAL_INVALID;
+  }
+
+  if (max_depth > UINT8_MAX)
+    max_depth = UINT8_MAX;
+
+  size_t depth = 0;
+  bool winner;
+  for (size_t i = 1; i <= max_depth && !depth && !solver.canceled; i++) {
+    if (_dfpn_win(&solver, state, history, state->turn, i)) {
+      depth = i;
+      winner = state->turn;
+    } else if (_dfpn_win(&solver, state, history, !state->turn, i)) {
+      depth = i;
+      winner = !state->turn;
+    }
+  }
+
+  if (!depth || solver.canceled) {
+    free(solver.table);
+    return EVAL_INVALID;
+  }
+
+  if (best_moves) {
+    move_t moves[256];
+    generate_moves(state, moves);
+
+    size_t length = 0;
+    size_t best_depth = 0;
+    for (size_t i = 0; is_valid_move(moves[i]); i++) {
+      do_move(state, history, moves[i]);
+      size_t move_depth =
+          _dfpn_win_depth(&solver, state, history, winner, depth - 1);
+      undo_last_move(state, history);
+
+      if (solver.canceled) {
+        free(solver.table);
+        return EVAL_INVALID;
+      }
+
+      // Moves of the winner that do not win in depth - 1 plies are not
+      // winning the fastest.
+      if (move_depth == DFPN_NO_WIN)
+        continue;
+
+      if (length && (state->turn == winner ? move_depth > best_depth
+                                           : move_depth < best_depth))
+        continue;
+
+      if (!length || move_depth != best_depth)
+        length = 0;
+
+      best_moves[length++] = moves[i];
+      best_depth = move_depth;
+    }
+    best_moves[length] = MOVE_INV;
+  }
+
+  free(solver.table);
+
+  size_t mate_size = history->size + depth;
+  return winner ? EVAL_WHITE_MATES - mate_size : EVAL_BLACK_MATES + mate_size;
+}
@@ -16,10 +16,16 @@ JazzInSea. If not, see <https://www.gnu.org/licenses/>.
 
 #define _GNU_SOURCE
 #include "ai/cache.h"
+#include "ai/dfpn.h"
 #include "ai/eval_t.h"
 #include "ai/iterative_deepening.h"
+#include "ai/mcts.h"
+#include "ai/mcts_tree.h"
 #include "ai/measure_count.h"
+#include "ai/move_ordering.h"
 #include "ai/search.h"
+#include "ai/split_point.h"
+#include "ai/time_manager.h"
 #include "ai/transposition_table.h"
 #include "board/board_t.h"
 #include "board/piece_t.h"
@@ -39,6 +45,7 @@ JazzInSea. If not, see <https://www.gnu.org/licenses/>.
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -80,97 +87,750 @@ const int TOPLEFT_KNIGHT_ISLAND_ADV_TABLE[4][4] = {{400, 450, 500, 600},
                                                    {500, 550, 720, 650},
                                                    {600, 670, 650, 700}};
 
-eval_t evaluate(board_state_t *state, history_t *history, size_t max_depth,
-                struct timespec max_time, size_t tt_size, move_t *best_moves) {
+typedef struct {
+  pthread_t thread;
+  _id_routine_args_t args;
 
-  // Reset the measuring variables.
-#ifdef MEASURE_EVAL_COUNT
-  position_evaluation_count = 0;
+  // Every thread works on its own copy of the board, history and cache. Only
+  // the transposition table is shared.
+  ai_cache_t cache;
+  board_state_t state;
+  history_t history;
 
-  evaluate_count = 0;
-  ab_branch_cut_count = 0;
-  game_end_count = 0;
-  leaf_count = 0;
+  move_t best_moves[256];
+  eval_t evaluation;
 
-  tt_remember_count = 0;
-  tt_saved_count = 0;
-  tt_overwritten_count = 0;
-  tt_rewritten_count = 0;
+#ifdef MEASURE_EVAL_COUNT
+  measure_count_t measure_count;
 #endif
+} search_thread_t;
+
+// The engine context, kept for the whole session. Every search starts with the
+// transposition table, the killer moves, the history scores and the
+// countermoves that the last search left behind.
+static ai_cache_t engine_cache;
+static bool engine_ready = false;
+
+// Size of the transposition table of the engine in megabytes.
+static size_t engine_tt_megabytes = TT_DEFAULT_MEGABYTES;
+
+static void _setup_engine() {
+  if (engine_ready)
+    return;
+
+  setup_cache(&engine_cache, TOPLEFT_PAWN_ADV_TABLE, TOPLEFT_KNIGHT_ADV_TABLE,
+              TOPLEFT_PAWN_CENTERED_ADV_TABLE, TOPLEFT_KNIGHT_CENTERED_ADV_TABLE,
+              TOPLEFT_PAWN_ISLAND_ADV_TABLE, TOPLEFT_KNIGHT_ISLAND_ADV_TABLE);
+
+  // If the table can not be allocated, use the largest size that can be.
+  while (!setup_transposition_table(&engine_cache, engine_tt_megabytes) &&
+         engine_tt_megabytes > 1)
+    engine_tt_megabytes /= 2;
+
+  engine_ready = true;
+}
+
+// Keep the move ordering tables of a finished search for the next search.
+static void _keep_move_tables(ai_cache_t *cache) {
+  memcpy(engine_cache.killer_moves, cache->killer_moves,
+         sizeof(engine_cache.killer_moves));
+  memcpy(engine_cache.history_scores, cache->history_scores,
+         sizeof(engine_cache.history_scores));
+  memcpy(engine_cache.countermoves, cache->countermoves,
+         sizeof(engine_cache.countermoves));
+}
+
+// A search in the background, while the engine waits for commands. When
+// pondering, the thread first predicts the reply of the opponent with a shallow
+// search, then searches the position after that reply until it is stopped.
+// Otherwise it analyses the position itself.
+typedef struct {
+  pthread_t thread;
+  bool running;
+  bool predict;
+
+  // Set for the analyses that keep running after the last depth, until they
+  // are stopped.
+  bool infinite;
+
+  // Set atomically to stop the search.
+  bool stop;
 
   ai_cache_t cache;
-  setup_cache(&cache, TOPLEFT_PAWN_ADV_TABLE, TOPLEFT_KNIGHT_ADV_TABLE,
-              TOPLEFT_PAWN_CENTERED_ADV_TABLE,
-              TOPLEFT_KNIGHT_CENTERED_ADV_TABLE, TOPLEFT_PAWN_ISLAND_ADV_TABLE,
-              TOPLEFT_KNIGHT_ISLAND_ADV_TABLE);
+  board_state_t state;
+  history_t history;
+  size_t max_depth;
 
-#ifdef MEASURE_EVAL_TIME
-  clock_t start = clock();
-#endif
+  // Set by the ponder thread once the reply is predicted, the position after
+  // the reply is described by the other fields.
+  bool predicted;
+  move_t predicted_move;
+  hash_t predicted_hash;
+  bool predicted_turn;
+  size_t predicted_history_size;
 
+  move_t best_moves[256];
   eval_t evaluation;
 
-  pthread_t thread;
+  struct timespec start;
+
+#ifdef MEASURE_EVAL_COUNT
+  measure_count_t measure_count;
+#endif
+} background_search_t;
+
+static background_search_t background;
+
+static void *_background_routine(void *r_background) {
+  background_search_t *background = (background_search_t *)r_background;
+
+#ifdef MEASURE_EVAL_COUNT
+  measure_count = (measure_count_t){0};
+#endif
+
   _id_routine_args_t args = {
-      .state = state,
-      .cache = &cache,
-      .history = history,
-      .best_moves = best_moves,
-      .evaluation = &evaluation,
-      .max_depth = max_depth,
+      .state = &background->state,
+      .cache = &background->cache,
+      .history = &background->history,
+      .best_moves = background->best_moves,
+      .evaluation = &background->evaluation,
+      .max_depth = background->max_depth,
+      .thread_id = 0,
+      .background = true,
   };
-  cache.cancel_search = false;
-  pthread_create(&thread, NULL, _id_routine, &args);
 
+  if (background->predict) {
+    if (args.max_depth > background->cache.ponder_prediction_depth)
+      args.max_depth = background->cache.ponder_prediction_depth;
+
+    _id_routine(&args);
+
+    if (__atomic_load_n(&background->stop, __ATOMIC_RELAXED) ||
+        !is_valid_move(background->best_moves[0]))
+      return NULL;
+
+    background->predicted_move = background->best_moves[0];
+    do_move(&background->state, &background->history,
+            background->predicted_move);
+    if (background->state.status != NORMAL)
+      return NULL;
+
+    background->predicted_hash = background->state.hash;
+    background->predicted_turn = background->state.turn;
+    background->predicted_history_size = background->history.size;
+    background->best_moves[0] = MOVE_INV;
+    background->evaluation = EVAL_INVALID;
+    start_unmanaged_time_manager(&background->cache.time_manager);
+    __atomic_store_n(&background->predicted, true, __ATOMIC_RELEASE);
+
+    args.max_depth = background->max_depth;
+  }
+
+  _id_routine(&args);
+
+#ifdef MEASURE_EVAL_COUNT
+  background->measure_count = measure_count;
+#endif
+
+  // Iterative deepening may end early, for example on a mate. An infinite
+  // analysis still waits to be stopped.
+  struct timespec poll_interval = {.tv_sec = 0, .tv_nsec = 1000000};
+  while (background->infinite &&
+         !__atomic_load_n(&background->stop, __ATOMIC_RELAXED))
+    nanosleep(&poll_interval, NULL);
+
+  return NULL;
+}
+
+// Stop the background search, and wait for it to return.
+static void _stop_background() {
+  if (!background.running)
+    return;
+
+#ifdef MEASURE_EVAL_TIME
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+#endif
+
+  __atomic_store_n(&background.stop, true, __ATOMIC_RELAXED);
+  pthread_join(background.thread, NULL);
+  free_search_stack(&background.cache);
+  background.running = false;
+
+#ifdef MEASURE_EVAL_TIME
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  io_debug();
+  pp_f("measure: stopped the background search in %zuus\n",
+       (size_t)((end.tv_sec - start.tv_sec) * 1000000 +
+                (end.tv_nsec - start.tv_nsec) / 1000));
+#endif
+}
+
+static void _start_background(board_state_t *state, history_t *history,
+                              size_t max_depth, bool predict, bool infinite) {
+  _stop_background();
+
+  _setup_engine();
+
+  engine_cache.tt_generation++;
+  age_history_scores(&engine_cache);
+  background.cache = engine_cache;
+  background.cache.stop_search = &background.stop;
+  setup_search_stack(&background.cache, max_depth);
+
+  background.state = *state;
+  background.history.size = history->size;
+  memcpy(background.history.history, history->history,
+         sizeof(history_item_t) * history->size);
+  background.max_depth = max_depth;
+  background.predict = predict;
+  background.infinite = infinite;
+  background.stop = false;
+
+  background.predicted = false;
+  background.best_moves[0] = MOVE_INV;
+  background.evaluation = EVAL_INVALID;
+
+  start_unmanaged_time_manager(&background.cache.time_manager);
+  clock_gettime(CLOCK_MONOTONIC, &background.start);
+  background.running = true;
+  pthread_create(&background.thread, NULL, _background_routine, &background);
+}
+
+// Cancel the ponder search if there is one, and wait for it to return.
+void stop_ponder() {
+  if (background.predict)
+    _stop_background();
+}
+
+// Start searching the position the opponent will most likely face after its
+// reply, in the background. The next call to evaluate uses the result if the
+// opponent plays the predicted move, and cancels the search otherwise.
+void start_ponder(board_state_t *state, history_t *history, size_t max_depth,
+                  parallel_mode_t parallel_mode) {
+  _stop_background();
+
+  // Monte Carlo trees are not kept between searches.
+  if (!engine_ready || parallel_mode == PARALLEL_MCTS ||
+      state->status != NORMAL)
+    return;
+
+  _start_background(state, history, max_depth, true, false);
+}
+
+// Set the size of the transposition table in megabytes. The table is allocated
+// and cleared right away, so that the next search does not wait for it. The
+// background search is stopped if the table changes.
+// Returns false and keeps the old table if the table can not be allocated.
+bool set_tt_size(size_t megabytes) {
+  if (engine_ready && megabytes == engine_tt_megabytes)
+    return true;
+
+  _stop_background();
+
+  if (!engine_ready) {
+    engine_tt_megabytes = megabytes;
+    _setup_engine();
+    return engine_tt_megabytes == megabytes;
+  }
+
+  if (!setup_transposition_table(&engine_cache, megabytes))
+    return false;
+
+  engine_tt_megabytes = megabytes;
+  return true;
+}
+
+// Start analysing the position in the background, until max_depth is reached
+// or stop_analysis is called. An infinite analysis only ends with
+// stop_analysis. The analysis runs on a single thread.
+void start_analysis(board_state_t *state, history_t *history, size_t max_depth,
+                    bool infinite) {
+  _start_background(state, history, max_depth, false, infinite);
+}
+
+// Stop the analysis and return the history of the analysed position, the best
+// moves and the evaluation of the last completed depth.
+// Returns NULL if no analysis was running.
+history_t *stop_analysis(move_t *best_moves, eval_t *evaluation) {
+  if (!background.running || background.predict)
+    return NULL;
+
+  _stop_background();
+
+  _keep_move_tables(&background.cache);
+
+#ifdef MEASURE_EVAL_COUNT
+  io_debug();
+  pp_f("measure: analysis called _evaluate %zu times.\n",
+       background.measure_count.evaluate_count);
+#endif
+
+  size_t length = 0;
+  do {
+    best_moves[length] = background.best_moves[length];
+  } while (is_valid_move(best_moves[length++]));
+
+  *evaluation = background.evaluation;
+  return &background.history;
+}
+
+// If the ponder search is searching the position, let it search with the time
+// limits counting from now and take its result. It stops on its own at the
+// soft limit, and is canceled at abs_end, the hard limit. Returns false if the
+// position was not pondered, or the ponder search could not finish its first
+// depth. Any other background search is stopped.
+static bool _take_ponder(board_state_t *state, history_t *history,
+                         time_limits_t time_limits, struct timespec abs_end,
+                         move_t *best_moves, eval_t *evaluation) {
+  if (!background.running)
+    return false;
+
+  if (!background.predict) {
+    _stop_background();
+    return false;
+  }
+
+  if (!__atomic_load_n(&background.predicted, __ATOMIC_ACQUIRE) ||
+      background.predicted_hash != state->hash ||
+      background.predicted_turn != state->turn ||
+      background.predicted_history_size != history->size) {
+    io_debug();
+    if (__atomic_load_n(&background.predicted, __ATOMIC_ACQUIRE)) {
+      pp_f("debug: ponder miss, predicted ");
+      pp_move(background.predicted_move);
+      pp_f("\n");
+    } else {
+      pp_f("debug: ponder miss, no move was predicted\n");
+    }
+    _stop_background();
+    return false;
+  }
+
+  manage_time_manager(&background.cache.time_manager, time_limits);
+  if (pthread_timedjoin_np(background.thread, NULL, &abs_end) == ETIMEDOUT) {
+    __atomic_store_n(&background.stop, true, __ATOMIC_RELAXED);
+    pthread_join(background.thread, NULL);
+  }
+
+  free_search_stack(&background.cache);
+  background.running = false;
+
+  _keep_move_tables(&background.cache);
+
+  if (!is_valid_move(background.best_moves[0])) {
+    io_debug();
+    pp_f("debug: ponder hit, but no depth was completed\n");
+    return false;
+  }
+
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  io_debug();
+  pp_f("debug: ponder hit, searched for %zums in total\n",
+       (size_t)((end.tv_sec - background.start.tv_sec) * 1000 +
+                (end.tv_nsec - background.start.tv_nsec) / 1000000));
+
+#ifdef MEASURE_EVAL_COUNT
+  pp_f("measure: pondering called _evaluate %zu times.\n",
+       background.measure_count.evaluate_count);
+#endif
+
+  size_t length = 0;
+  do {
+    best_moves[length] = background.best_moves[length];
+  } while (is_valid_move(best_moves[length++]));
+
+  *evaluation = background.evaluation;
+  return true;
+}
+
+static void *_search_thread_routine(void *r_thread) {
+  search_thread_t *thread = (search_thread_t *)r_thread;
+
+#ifdef MEASURE_EVAL_COUNT
+  measure_count = (measure_count_t){0};
+#endif
+
+  // In split mode, only the main thread runs iterative deepening. In MCTS
+  // mode, all of the threads run the same routine.
+  if (thread->cache.mcts_tree) {
+    _mcts_routine(&thread->args);
+  } else if (thread->cache.split_pool && thread->args.thread_id) {
+    _split_worker_routine(&thread->state, &thread->history, &thread->cache);
+  } else {
+    _id_routine(&thread->args);
+  }
+
+#ifdef MEASURE_EVAL_COUNT
+  thread->measure_count = measure_count;
+#endif
+
+  return NULL;
+}
+
+eval_t evaluate(board_state_t *state, history_t *history, size_t max_depth,
+                time_limits_t time_limits, size_t tt_size, size_t thread_count,
+                parallel_mode_t parallel_mode, multipv_t *multipv,
+                move_t *best_moves) {
+
+  // The search is canceled at the hard limit, the main thread stops at the
+  // soft limit by itself.
   struct timespec abs_end;
   clock_gettime(CLOCK_REALTIME, &abs_end);
-  abs_end.tv_sec += max_time.tv_sec;
-  abs_end.tv_nsec += max_time.tv_nsec;
+  abs_end.tv_sec += time_limits.hard.tv_sec;
+  abs_end.tv_nsec += time_limits.hard.tv_nsec;
 
   abs_end.tv_sec += abs_end.tv_nsec / 1000000000;
   abs_end.tv_nsec %= 1000000000;
 
-  int result = pthread_timedjoin_np(thread, NULL, &abs_end);
+  // The ponder search continues on the remaining time if it predicted the move
+  // of the opponent.
+  eval_t ponder_evaluation;
+  if (_take_ponder(state, history, time_limits, abs_end, best_moves,
+                   &ponder_evaluation)) {
+    if (multipv)
+      multipv->count = 0;
+    return ponder_evaluation;
+  }
+
+  set_tt_size(tt_size);
+
+  engine_cache.tt_generation++;
+  age_history_scores(&engine_cache);
+
+  // The search works on a copy of the context, the transposition table is
+  // shared with it.
+  ai_cache_t cache = engine_cache;
+  bool stop = false;
+  cache.stop_search = &stop;
+  start_time_manager(&cache.time_manager, time_limits);
+
+  if (!thread_count)
+    thread_count = 1;
+
+  split_pool_t split_pool;
+  if (parallel_mode == PARALLEL_SPLIT && thread_count > 1) {
+    setup_split_pool(&split_pool);
+    cache.split_pool = &split_pool;
+  }
+
+  // Monte Carlo tree search does not search the root moves exactly. If its
+  // tree can not be allocated, the threads run iterative deepening instead.
+  mcts_tree_t mcts_tree;
+  if (parallel_mode == PARALLEL_MCTS) {
+    if (setup_mcts_tree(&mcts_tree, cache.mcts_pool_size)) {
+      cache.mcts_tree = &mcts_tree;
+
+      if (multipv)
+        multipv->count = 0;
+    } else {
+      io_error();
+      pp_f("error: could not allocate the Monte Carlo tree, searching with "
+           "iterative deepening\n");
+    }
+  }
+
+#ifdef MEASURE_EVAL_TIME
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+#endif
+
+  search_thread_t *threads = malloc(sizeof(search_thread_t) * thread_count);
+
+  // Start all of the search threads. Thread 0 is the main thread, its result
+  // is the result of the search.
+  for (size_t i = 0; i < thread_count; i++) {
+    search_thread_t *thread = &threads[i];
+
+    thread->cache = cache;
+    setup_search_stack(&thread->cache, max_depth);
+
+    // Keep the playouts of the threads different, but repeatable with the
+    // same seed.
+    if (cache.mcts_tree)
+      thread->cache.mcts_random = (uint64_t)rand() << 32 | rand() | 1;
+    thread->state = *state;
+
+    // Only copy the used part of the history.
+    thread->history.size = history->size;
+    memcpy(thread->history.history, history->history,
+           sizeof(history_item_t) * history->size);
+
+    thread->args = (_id_routine_args_t){
+        .state = &thread->state,
+        .cache = &thread->cache,
+        .history = &thread->history,
+        .best_moves = thread->best_moves,
+        .evaluation = &thread->evaluation,
+        .max_depth = max_depth,
+        .thread_id = i,
+        .multipv = multipv,
+    };
+
+    thread->best_moves[0] = MOVE_INV;
+    thread->evaluation = EVAL_INVALID;
+
+    pthread_create(&thread->thread, NULL, _search_thread_routine, thread);
+  }
+
+  // The main thread may be waiting for the other threads to finish their
+  // part of a split point, so cancel all of them.
+  int result = pthread_timedjoin_np(threads[0].thread, NULL, &abs_end);
   if (result == ETIMEDOUT) {
-    cache.cancel_search = true;
-    pthread_join(thread, NULL);
+    __atomic_store_n(&stop, true, __ATOMIC_RELAXED);
+    pthread_join(threads[0].thread, NULL);
   }
 
+  // The main thread is done, stop the helper threads as well.
+  __atomic_store_n(&stop, true, __ATOMIC_RELAXED);
+
+  if (cache.split_pool)
+    stop_split_pool(cache.split_pool);
+
+  for (size_t i = 1; i < thread_count; i++)
+    pthread_join(threads[i].thread, NULL);
+
+  eval_t evaluation = threads[0].evaluation;
+
+  size_t length = 0;
+  do {
+    best_moves[length] = threads[0].best_moves[length];
+  } while (is_valid_move(best_moves[length++]));
+
 #ifdef MEASURE_EVAL_TIME
-  pp_f("measure: took %dms\n", (clock() - start) / (CLOCKS_PER_SEC / 1000));
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  size_t milliseconds = (end.tv_sec - start.tv_sec) * 1000 +
+                        (end.tv_nsec - start.tv_nsec) / 1000000;
+
+  io_debug();
+  pp_f("measure: took %zums\n", milliseconds);
 #endif
 
 #ifdef MEASURE_EVAL_COUNT
-  pp_f("measure: called _evaluate %d times.\n", evaluate_count);
-  pp_f("measure: cut %d branches.\n", ab_branch_cut_count);
-  if (evaluate_count != 0) {
+  measure_count_t total = {0};
+  for (size_t i = 0; i < thread_count; i++)
+    add_measure_count(&total, &threads[i].measure_count);
+
+  io_debug();
+  if (thread_count > 1) {
+    for (size_t i = 0; i < thread_count; i++) {
+      pp_f("measure: thread %zu called _evaluate %zu times.\n", i,
+           threads[i].measure_count.evaluate_count);
+    }
+  }
+
+#ifdef MEASURE_EVAL_TIME
+  if (milliseconds != 0) {
+    pp_f("measure: searched %zu nodes per second with %zu threads.\n",
+         total.evaluate_count * 1000 / milliseconds, thread_count);
+  }
+#endif
+
+  pp_f("measure: called _evaluate %d times.\n", total.evaluate_count);
+  pp_f("measure: cut %d branches.\n", total.ab_branch_cut_count);
+  if (total.ab_branch_cut_count != 0) {
+    pp_f("measure: cut %zu (%zu %%) branches on the first move.\n",
+         total.first_move_cut_count,
+         total.first_move_cut_count * 100 / total.ab_branch_cut_count);
+  }
+  pp_f("measure: re-searched %zu null window searches.\n",
+       total.pvs_research_count);
+  pp_f("measure: re-searched %zu (%zu failed low, %zu failed high) aspiration "
+       "windows.\n",
+       total.aspiration_fail_low_count + total.aspiration_fail_high_count,
+       total.aspiration_fail_low_count, total.aspiration_fail_high_count);
+  pp_f("measure: pruned %zu futile moves and %zu late moves, razored %zu "
+       "nodes.\n",
+       total.futility_prune_count, total.late_move_prune_count,
+       total.razoring_cut_count);
+  pp_f("measure: reduced %zu late moves by 1",
+       total.late_move_reduction_counts[0]);
+  for (size_t i = 1; i < LMR_STATS; i++) {
+    pp_f(", %zu by %zu%s", total.late_move_reduction_counts[i], i + 1,
+         i + 1 == LMR_STATS ? " or more" : "");
+  }
+  pp_f(" plies, re-searched %zu.\n", total.late_move_research_count);
+  pp_f("measure: ran %zu internal iterative deepening searches.\n",
+       total.iid_count);
+  pp_f("measure: picked %zu hash moves, %zu killer moves and countermoves, "
+       "scored %zu moves.\n",
+       total.picked_hash_move_count, total.picked_killer_count,
+       total.scored_move_count);
+  pp_f("measure: cut %zu of %zu ProbCut searches, cut %zu multi-cut "
+       "searches.\n",
+       total.probcut_cut_count, total.probcut_try_count,
+       total.multi_cut_count);
+  pp_f("measure: cut %zu null move searches, %zu failed verification.\n",
+       total.null_move_cut_count, total.null_move_fail_count);
+  pp_f("measure: searched %zu quiescence nodes, %zu quiet leaves and %zu "
+       "cuts.\n",
+       total.quiescence_count, total.quiescence_leaf_count,
+       total.quiescence_cut_count);
+  pp_f("measure: solved %zu lone piece positions with %zu solver nodes.\n",
+       total.lone_solved_count, total.lone_solver_count);
+  if (cache.split_pool)
+    pp_f("measure: created %zu split points.\n", total.split_count);
+  if (cache.mcts_tree) {
+    pp_f("measure: ran %zu playouts, allocated %zu of %zu tree nodes.\n",
+         total.mcts_playout_count,
+         mcts_tree.pool_full ? mcts_tree.pool_capacity : mcts_tree.pool_size,
+         mcts_tree.pool_capacity);
+  }
+  if (total.evaluate_count != 0) {
     pp_f("measure: called get_board_evaluation %d (%d %%) times.\n",
-         position_evaluation_count,
-         position_evaluation_count * 100 / evaluate_count);
+         total.position_evaluation_count,
+         total.position_evaluation_count * 100 / total.evaluate_count);
     pp_f("measure: called generate_moves %d (%d %%) times.\n",
-         move_generation_count, move_generation_count * 100 / evaluate_count);
-    pp_f("measure: found %d (%d %%) different game ends.\n", game_end_count,
-         game_end_count * 100 / evaluate_count);
-    pp_f("measure: found total %d (%d %%) leaves.\n", leaf_count,
-         leaf_count * 100 / evaluate_count);
+         total.move_generation_count,
+         total.move_generation_count * 100 / total.evaluate_count);
+    pp_f("measure: found %d (%d %%) different game ends.\n",
+         total.game_end_count,
+         total.game_end_count * 100 / total.evaluate_count);
+    pp_f("measure: found total %d (%d %%) leaves.\n", total.leaf_count,
+         total.leaf_count * 100 / total.evaluate_count);
   }
 
   pp_f("measure: in total, used %d (%d %%) transposition tables entries.\n",
-       tt_saved_count, tt_saved_count * 100 / cache.tt_size);
-  if (tt_saved_count != 0) {
-    if (evaluate_count != 0) {
+       total.tt_saved_count,
+       total.tt_saved_count * 100 /
+           (cache.tt_bucket_count * TT_BUCKET_ENTRIES));
+  if (total.tt_saved_count != 0) {
+    if (total.evaluate_count != 0) {
       pp_f("measure: remembered %d (%d %% per call, %d %% per entry) times.\n",
-           tt_remember_count, tt_remember_count * 100 / evaluate_count,
-           tt_remember_count * 100 / tt_saved_count);
+           total.tt_remember_count,
+           total.tt_remember_count * 100 / total.evaluate_count,
+           total.tt_remember_count * 100 / total.tt_saved_count);
     }
+    pp_f("measure: used %zu of %zu exact, %zu of %zu lower bound and %zu of "
+         "%zu upper bound entries.\n",
+         total.tt_hit_counts[EXACT], total.tt_probe_counts[EXACT],
+         total.tt_hit_counts[LOWER], total.tt_probe_counts[LOWER],
+         total.tt_hit_counts[UPPER], total.tt_probe_counts[UPPER]);
     pp_f("measure: overwritten the same board %u (%u %%) times.\n",
-         tt_overwritten_count, tt_overwritten_count * 100 / tt_saved_count);
+         total.tt_overwritten_count,
+         total.tt_overwritten_count * 100 / total.tt_saved_count);
     pp_f("measure: rewritten a different board %u (%u %%) times.\n",
-         tt_rewritten_count, tt_rewritten_count * 100 / tt_saved_count);
+         total.tt_rewritten_count,
+         total.tt_rewritten_count * 100 / total.tt_saved_count);
   }
 #endif
 
-  free_cache(&cache);
+  // Keep the move ordering tables of the main thread for the next search.
+  _keep_move_tables(&threads[0].cache);
+
+  for (size_t i = 0; i < thread_count; i++)
+    free_search_stack(&threads[i].cache);
+
+  free(threads);
+
+  if (cache.split_pool)
+    free_split_pool(cache.split_pool);
+
+  if (cache.mcts_tree)
+    free_mcts_tree(cache.mcts_tree);
+
+  return evaluation;
+}
+
+typedef struct {
+  pthread_t thread;
+  bool cancel_search;
+
+  board_state_t state;
+  history_t history;
+  size_t max_depth;
+
+  move_t best_moves[256];
+  eval_t evaluation;
+
+#ifdef MEASURE_EVAL_COUNT
+  measure_count_t measure_count;
+#endif
+} solve_thread_t;
+
+static void *_solve_thread_routine(void *r_thread) {
+  solve_thread_t *thread = (solve_thread_t *)r_thread;
+
+#ifdef MEASURE_EVAL_COUNT
+  measure_count = (measure_count_t){0};
+#endif
+
+  thread->evaluation =
+      dfpn_solve(&thread->state, &thread->history, &thread->cancel_search,
+                 thread->max_depth, thread->best_moves);
+
+#ifdef MEASURE_EVAL_COUNT
+  thread->measure_count = measure_count;
+#endif
+
+  return NULL;
+}
+
+// Find the exact mate distance of the position, searching at most max_depth
+// plies.
+// Returns EVAL_INVALID if no mate was found.
+eval_t solve(board_state_t *state, history_t *history, size_t max_depth,
+             struct timespec max_time, move_t *best_moves) {
+  best_moves[0] = MOVE_INV;
+
+#ifdef MEASURE_EVAL_TIME
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+#endif
+
+  solve_thread_t *thread = malloc(sizeof(solve_thread_t));
+  thread->cancel_search = false;
+  thread->state = *state;
+  thread->history.size = history->size;
+  memcpy(thread->history.history, history->history,
+         sizeof(history_item_t) * history->size);
+  thread->max_depth = max_depth;
+  thread->best_moves[0] = MOVE_INV;
+
+  struct timespec abs_end;
+  clock_gettime(CLOCK_REALTIME, &abs_end);
+  abs_end.tv_sec += max_time.tv_sec;
+  abs_end.tv_nsec += max_time.tv_nsec;
+
+  abs_end.tv_sec += abs_end.tv_nsec / 1000000000;
+  abs_end.tv_nsec %= 1000000000;
+
+  pthread_create(&thread->thread, NULL, _solve_thread_routine, thread);
+
+  if (pthread_timedjoin_np(thread->thread, NULL, &abs_end) == ETIMEDOUT) {
+    __atomic_store_n(&thread->cancel_search, true, __ATOMIC_RELAXED);
+    pthread_join(thread->thread, NULL);
+  }
+
+  eval_t evaluation = thread->evaluation;
+
+  size_t length = 0;
+  do {
+    best_moves[length] = thread->best_moves[length];
+  } while (is_valid_move(best_moves[length++]));
+
+#ifdef MEASURE_EVAL_TIME
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  size_t milliseconds = (end.tv_sec - start.tv_sec) * 1000 +
+                        (end.tv_nsec - start.tv_nsec) / 1000000;
+
+  io_debug();
+  pp_f("measure: took %zums\n", milliseconds);
+#endif
+
+#ifdef MEASURE_EVAL_COUNT
+  io_debug();
+  pp_f("measure: searched %zu df-pn nodes.\n",
+       thread->measure_count.dfpn_count);
+#endif
+
+  free(thread);
 
   return evaluation;
 }
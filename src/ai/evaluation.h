@@ -19,6 +19,9 @@ JazzInSea. If not, see <https://www.gnu.org/licenses/>.
 
 #include "ai/cache.h"
 #include "ai/eval_t.h"
+#include "ai/iterative_deepening.h"
+#include "ai/split_point.h"
+#include "ai/time_manager.h"
 #include "ai/transposition_table.h"
 #include "board/board_t.h"
 #include "board/pos_t.h"
@@ -32,7 +35,13 @@ JazzInSea. If not, see <https://www.gnu.org/licenses/>.
 #include <stdlib.h>
 #include <time.h>
 
-eval_t evaluate(board_state_t *, history_t *, size_t, struct timespec, size_t,
-                move_t *);
+eval_t evaluate(board_state_t *, history_t *, size_t, time_limits_t, size_t,
+                size_t, parallel_mode_t, multipv_t *, move_t *);
+bool set_tt_size(size_t);
+void start_ponder(board_state_t *, history_t *, size_t, parallel_mode_t);
+void stop_ponder();
+void start_analysis(board_state_t *, history_t *, size_t, bool);
+history_t *stop_analysis(move_t *, eval_t *);
+eval_t solve(board_state_t *, history_t *, size_t, struct timespec, move_t *);
 
 #endif
@@ -17,14 +17,112 @@ JazzInSea. If not, see <https://www.gnu.org/licenses/>.
 #include "ai/iterative_deepening.h"
 #include "ai/cache.h"
 #include "ai/eval_t.h"
+#include "ai/lone_solver.h"
+#include "ai/measure_count.h"
 #include "ai/move_ordering.h"
 #include "ai/position_evaluation.h"
 #include "ai/search.h"
+#include "ai/time_manager.h"
 #include "io/pp.h"
 #include "move/generation.h"
 #include "move/make_move.h"
 #include "move/move_t.h"
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+// Check if there is time left to search another depth, after a depth that
+// started at iteration_start_ms was completed with best_move as its best move.
+static bool _next_depth_fits(ai_cache_t *cache, size_t iteration_start_ms,
+                             move_t best_move) {
+  time_manager_t *manager = &cache->time_manager;
+
+  size_t elapsed_ms = get_elapsed_ms(manager);
+  size_t iteration_ms = elapsed_ms - iteration_start_ms;
+
+  manager->previous_iteration_ms = manager->last_iteration_ms;
+  manager->last_iteration_ms = iteration_ms;
+
+  if (compare_move(best_move, manager->best_move)) {
+    manager->stable_iterations++;
+  } else {
+    manager->best_move = best_move;
+    manager->stable_iterations = 0;
+  }
+
+  // The depths of a search that is not managed yet are still timed, in case it
+  // becomes managed.
+  if (!is_time_managed(manager))
+    return true;
+  elapsed_ms -= manager->offset_ms;
+
+  // Predict the duration of the next depth with the effective branching
+  // factor of the last two depths.
+  size_t branching = cache->time_default_branching;
+  if (manager->previous_iteration_ms >= cache->time_min_measured_ms) {
+    branching = (manager->last_iteration_ms * 2 + manager->previous_iteration_ms) /
+                (manager->previous_iteration_ms * 2);
+    if (!branching)
+      branching = 1;
+  }
+
+  size_t soft_ms = manager->soft_ms;
+  if (manager->stable_iterations >= cache->time_stable_iterations)
+    soft_ms = soft_ms * cache->time_stable_percent / 100;
+
+  return elapsed_ms + iteration_ms * branching <= soft_ms;
+}
+
+// Return the n-th best of the evaluations for the player, counting from 1.
+static eval_t _nth_best_evaluation(eval_t *evals, size_t count, size_t n,
+                                   bool turn) {
+  // Keep the n best evaluations sorted, best first.
+  eval_t best[MULTIPV_MAX];
+  size_t length = 0;
+
+  for (size_t i = 0; i < count; i++) {
+    size_t j = length;
+    while (j > 0 && (turn ? evals[i] > best[j - 1] : evals[i] < best[j - 1])) {
+      if (j < n)
+        best[j] = best[j - 1];
+      j--;
+    }
+
+    if (j < n) {
+      best[j] = evals[i];
+      if (length < n)
+        length++;
+    }
+  }
+
+  return best[n - 1];
+}
+
+// Fill the multi-PV result with the best moves, best first. Moves with the
+// same evaluation keep their order.
+static void _select_multipv(multipv_t *multipv, size_t count, move_t *moves,
+                            eval_t *evals, bool turn) {
+  bool selected[256] = {false};
+
+  multipv->count = count;
+  for (size_t i = 0; i < count; i++) {
+    size_t best = 0;
+    while (selected[best])
+      best++;
+
+    for (size_t j = best + 1; is_valid_move(moves[j]); j++) {
+      if (!selected[j] &&
+          (turn ? evals[j] > evals[best] : evals[j] < evals[best]))
+        best = j;
+    }
+
+    selected[best] = true;
+    multipv->moves[i] = moves[best];
+    multipv->evaluations[i] = evals[best];
+  }
+}
+
 void *_id_routine(void *r_args) {
   _id_routine_args_t *args = (_id_routine_args_t *)r_args;
 
@@ -34,17 +132,48 @@ void *_id_routine(void *r_args) {
   move_t *best_moves = args->best_moves;
   size_t max_depth = args->max_depth;
   eval_t *evaluation = args->evaluation;
+  bool main_thread = !args->thread_id;
+
+  // Background searches share the output streams with the command loop, so
+  // they do not print anything.
+  bool verbose = main_thread && !args->background;
 
   // Dump the board information for debugging.
-  io_debug();
-  pp_f("debug: calling _evaluate for color %s\n",
-       state->turn ? "white" : "black");
-  pp_board(state->board);
+  if (verbose) {
+    io_debug();
+    pp_f("debug: calling _evaluate for color %s\n",
+         state->turn ? "white" : "black");
+    pp_board(state->board);
+  }
+
+  // The lone piece solver remembers its results for the whole search.
+  clear_lone_solver();
 
   move_t moves[256];
   eval_t evals[256];
   generate_moves(state, moves);
 
+  // The number of root moves that are searched exactly. The other moves are
+  // only searched to check that they are worse than the last of them. The
+  // result stays empty until the first depth is completed.
+  multipv_t *multipv = main_thread ? args->multipv : NULL;
+  size_t pv_count = 1;
+  if (multipv) {
+    pv_count = multipv->count;
+    multipv->count = 0;
+
+    size_t move_count = 0;
+    while (is_valid_move(moves[move_count]))
+      move_count++;
+
+    if (pv_count > move_count)
+      pv_count = move_count;
+    if (pv_count > MULTIPV_MAX)
+      pv_count = MULTIPV_MAX;
+    if (!pv_count)
+      pv_count = 1;
+  }
+
   // If there are no moves available, return draw by no moves.
   if (!is_valid_move(moves[0])) {
     best_moves[0] = MOVE_INV;
@@ -60,67 +189,215 @@ void *_id_routine(void *r_args) {
     return NULL;
   }
 
+  // If a player is down to a single piece, try to solve the position first.
+  // Helper threads start the regular search right away, in case the solver
+  // can not find a mate.
+  if (main_thread && is_lone_position(state)) {
+    eval_t lone_eval = lone_solve(state, history, cache->stop_search,
+                                  max_depth, best_moves);
+
+    if (lone_eval != EVAL_INVALID) {
+#ifdef MEASURE_EVAL_COUNT
+      measure_count.lone_solved_count++;
+#endif
+
+      if (verbose) {
+        io_debug();
+        pp_f("debug: solved lone piece position, ");
+        pp_eval(lone_eval, state->board, history);
+        pp_f("\n");
+      }
+
+      *evaluation = lone_eval;
+      return NULL;
+    }
+
+    // The solver used all of the time, play any move rather than none.
+    if (is_search_stopped(cache)) {
+      best_moves[0] = moves[0];
+      best_moves[1] = MOVE_INV;
+      *evaluation = EVAL_INVALID;
+
+      if (verbose) {
+        io_debug();
+        pp_f("[search canceled]\n");
+      }
+      return NULL;
+    }
+  }
+
   // Reset all of the evals.
   for (size_t i = 0; i < is_valid_move(moves[i]); i++) {
     evals[i] = EVAL_INVALID;
   }
 
-  move_t killer_moves[256] = {MOVE_INV};
+  // Evaluation of the last completed depth.
+  eval_t last_evaluation = EVAL_INVALID;
 
   // Iterate depths from 1 to max_depth.
   for (size_t depth = 1; depth <= max_depth; depth++) {
-    order_moves(state, cache, moves, state->turn, killer_moves);
+    // Half of the helper threads skip the odd depths and the other half skip
+    // the even depths.
+    if (!main_thread && depth < max_depth && (depth + args->thread_id) % 2)
+      continue;
 
-    eval_t alpha = EVAL_BLACK_MATES;
-    eval_t beta = EVAL_WHITE_MATES;
+    size_t iteration_start_ms = get_elapsed_ms(&cache->time_manager);
 
-    // Iterate all moves.
-    for (size_t i = 0; is_valid_move(moves[i]); i++) {
-      // TODO: Implement ignoring absolute evaluations.
-      /* // Ignore moves that are already known to be mates. */
-      /* if (evals[i] != EVAL_INVALID && is_mate(evals[i])) */
-      /*   continue; */
+    order_moves(state, history, cache, moves, state->turn);
 
-      do_move(state, history, moves[i]);
+    // Search the best move of the last depth first. If the depth is canceled,
+    // its evaluation is then known before the others.
+    for (size_t i = 1; is_valid_move(best_moves[0]) && is_valid_move(moves[i]);
+         i++) {
+      if (compare_move(moves[i], best_moves[0])) {
+        move_t move = moves[i];
+        memmove(&moves[1], &moves[0], sizeof(move_t) * i);
+        moves[0] = move;
+        break;
+      }
+    }
 
-      // Since this is done at max 16 times, no need to do delta evaluation.
-      int old_evaluation = get_board_evaluation(state, cache);
+    // The best move searched in this depth, if it is better than the best move
+    // of the last depth.
+    move_t partial_move = MOVE_INV;
+    eval_t partial_evaluation = last_evaluation;
 
-      eval_t move_eval = _evaluate(state, history, cache, depth - 1,
-                                   old_evaluation, alpha, beta, killer_moves);
+    // Search with a window around the evaluation of the last depth. If the
+    // evaluation falls outside of the window, widen the window on that side
+    // and search the depth again.
+    eval_t window = cache->aspiration_window;
+    eval_t window_alpha = EVAL_BLACK_MATES;
+    eval_t window_beta = EVAL_WHITE_MATES;
 
-      undo_last_move(state, history);
+    if (pv_count == 1 && last_evaluation != EVAL_INVALID &&
+        !is_mate(last_evaluation) && depth >= cache->aspiration_min_depth) {
+      window_alpha = last_evaluation - window;
+      window_beta = last_evaluation + window;
+    }
 
-      if (move_eval == EVAL_INVALID) {
-        io_debug();
-        pp_f("[search canceled]\n");
-        return NULL;
-      }
+    while (true) {
+      eval_t alpha = window_alpha;
+      eval_t beta = window_beta;
+      eval_t best_evaluation =
+          state->turn ? EVAL_BLACK_MATES : EVAL_WHITE_MATES;
+
+      // Iterate all moves.
+      for (size_t i = 0; is_valid_move(moves[i]); i++) {
+        // TODO: Implement ignoring absolute evaluations.
+        /* // Ignore moves that are already known to be mates. */
+        /* if (evals[i] != EVAL_INVALID && is_mate(evals[i])) */
+        /*   continue; */
+
+        do_move(state, history, moves[i]);
+
+        // Since this is done at max 16 times, no need to do delta evaluation.
+        int old_evaluation = get_board_evaluation(state, cache);
+
+        eval_t move_eval = _evaluate(state, history, cache, depth - 1,
+                                     old_evaluation, alpha, beta);
 
-      evals[i] = move_eval;
+        undo_last_move(state, history);
 
-      // Update alpha and beta bounds.
-      if (state->turn) {
-        if (move_eval > alpha) {
-          alpha = move_eval;
+        if (move_eval == EVAL_INVALID) {
+          // A move that beats the last depth is better than the result of the
+          // last depth.
+          if (is_valid_move(partial_move)) {
+            best_moves[0] = partial_move;
+            best_moves[1] = MOVE_INV;
+            *evaluation = partial_evaluation;
+          }
+
+          if (verbose) {
+            io_debug();
+            pp_f("[search canceled]\n");
+            if (is_valid_move(partial_move))
+              pp_f("debug: depth=%u, using the partial result\n", depth);
+          }
+          return NULL;
         }
-      } else {
-        if (move_eval < beta) {
-          beta = move_eval;
+
+        evals[i] = move_eval;
+
+        if (partial_evaluation == EVAL_INVALID ||
+            (state->turn ? move_eval > partial_evaluation
+                         : move_eval < partial_evaluation)) {
+          partial_move = moves[i];
+          partial_evaluation = move_eval;
+        }
+
+        if (state->turn ? move_eval > best_evaluation
+                        : move_eval < best_evaluation)
+          best_evaluation = move_eval;
+
+        // Update alpha and beta bounds. With multiple PVs, the bound is the
+        // last of the best moves, so that all of them get exact evaluations.
+        eval_t bound = move_eval;
+        if (pv_count > 1) {
+          if (i + 1 < pv_count)
+            bound = state->turn ? EVAL_BLACK_MATES : EVAL_WHITE_MATES;
+          else
+            bound = _nth_best_evaluation(evals, i + 1, pv_count, state->turn);
+        }
+
+        if (state->turn) {
+          if (bound > alpha)
+            alpha = bound;
+        } else {
+          if (bound < beta)
+            beta = bound;
         }
+
+        // If a move is better than the window, there is no need to search the
+        // other moves, the window has to be widened anyways.
+        if (state->turn ? move_eval > window_beta : move_eval < window_alpha)
+          break;
+      }
+
+      // Widen the window and search again if the evaluation is not inside the
+      // window. The evaluation is a bound, so widen starting from it. If it
+      // is a mate, open the window completely.
+      if (best_evaluation < window_alpha) {
+#ifdef MEASURE_EVAL_COUNT
+        measure_count.aspiration_fail_low_count++;
+#endif
+        window *= cache->aspiration_widening;
+        window_alpha = best_evaluation - window;
+        if (is_mate(best_evaluation) || is_mate(window_alpha))
+          window_alpha = EVAL_BLACK_MATES;
+
+      } else if (best_evaluation > window_beta) {
+#ifdef MEASURE_EVAL_COUNT
+        measure_count.aspiration_fail_high_count++;
+#endif
+        window *= cache->aspiration_widening;
+        window_beta = best_evaluation + window;
+        if (is_mate(best_evaluation) || is_mate(window_beta))
+          window_beta = EVAL_WHITE_MATES;
+
+      } else {
+        break;
+      }
+
+      if (verbose) {
+        io_debug();
+        pp_f("debug: depth=%u, evaluation outside of aspiration window, "
+             "searching again\n",
+             depth);
       }
     }
 
     // Print the move evaluation scores.
-    io_debug();
-    pp_f("depth=%u, { ", depth);
-    for (size_t i = 0; is_valid_move(moves[i]); i++) {
-      pp_move(moves[i]);
-      pp_f(": ");
-      pp_eval(evals[i], state->board, history);
-      pp_f(", ");
+    if (verbose) {
+      io_debug();
+      pp_f("depth=%u, { ", depth);
+      for (size_t i = 0; is_valid_move(moves[i]); i++) {
+        pp_move(moves[i]);
+        pp_f(": ");
+        pp_eval(evals[i], state->board, history);
+        pp_f(", ");
+      }
+      pp_f("}\n");
     }
-    pp_f("}\n");
 
     // Select the best moves.
     *evaluation = state->turn ? EVAL_BLACK_MATES : EVAL_WHITE_MATES;
@@ -135,10 +412,40 @@ void *_id_routine(void *r_args) {
       }
     }
     best_moves[length] = MOVE_INV;
+    last_evaluation = *evaluation;
+
+    if (multipv) {
+      _select_multipv(multipv, pv_count, moves, evals, state->turn);
+
+      if (verbose) {
+        io_debug();
+        for (size_t i = 0; i < multipv->count; i++) {
+          pp_f("depth=%u, pv=%zu, ", depth, i + 1);
+          pp_move(multipv->moves[i]);
+          pp_f(" -> ");
+          pp_eval(multipv->evaluations[i], state->board, history);
+          pp_f("\n");
+        }
+      }
+    }
 
     if (is_mate(*evaluation)) {
-      io_debug();
-      pp_f("debug: reached unavoidable mate, stopping iterative deepening\n");
+      if (verbose) {
+        io_debug();
+        pp_f("debug: reached unavoidable mate, stopping iterative "
+             "deepening\n");
+      }
+      break;
+    }
+
+    if (main_thread &&
+        !_next_depth_fits(cache, iteration_start_ms, best_moves[0])) {
+      if (verbose) {
+        io_debug();
+        pp_f("debug: depth=%u, next depth does not fit in time, stopping "
+             "iterative deepening\n",
+             depth);
+      }
       break;
     }
   }
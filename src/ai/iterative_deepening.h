@@ -19,11 +19,23 @@ JazzInSea. If not, see <https://www.gnu.org/licenses/>.
 
 #include "ai/cache.h"
 #include "ai/eval_t.h"
+#include "move/move_t.h"
 #include "state/board_state_t.h"
 #include "state/history.h"
 
 #include <stddef.h>
 
+#define MULTIPV_MAX 32
+
+// The best root moves of a search, best first, with their exact evaluations.
+// Set count to the number of moves to search exactly before the search, it is
+// lowered if there are not enough moves.
+typedef struct {
+  size_t count;
+  move_t moves[MULTIPV_MAX];
+  eval_t evaluations[MULTIPV_MAX];
+} multipv_t;
+
 typedef struct {
   board_state_t *state;
   history_t *history;
@@ -31,6 +43,19 @@ typedef struct {
   size_t max_depth;
   move_t *best_moves;
   eval_t *evaluation;
+
+  // Index of the search thread, 0 for the main thread.
+  // Helper threads do not print and search a different set of depths than the
+  // main thread, so that they fill the shared transposition table with
+  // entries the main thread will need.
+  size_t thread_id;
+
+  // Set for the searches that run in the background, like pondering.
+  bool background;
+
+  // If set, the main thread searches the best multipv->count root moves
+  // exactly instead of only the best one.
+  multipv_t *multipv;
 } _id_routine_args_t;
 
 void *_id_routine(void *r_args);
@@ -0,0 +1,308 @@
+/*
+This file is part of JazzInSea.
+
+JazzInSea is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+JazzInSea is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+JazzInSea. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "ai/lone_solver.h"
+#include "ai/eval_t.h"
+#include "ai/measure_count.h"
+#include "board/bb_tables.h"
+#include "board/piece_t.h"
+#include "board/pos_t.h"
+#include "board/status_t.h"
+#include "move/generation.h"
+#include "move/make_move.h"
+#include "move/move_t.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define LONE_TABLE_SIZE 0x1000
+#define LONE_NO_WIN SIZE_MAX
+
+typedef struct {
+  hash_t hash;
+  bool turn;
+  bool attacker;
+
+  // The attacker can force a win in win_depth plies, 0 if not known.
+  uint8_t win_depth;
+
+  // The attacker can not force a win in fail_depth plies.
+  uint8_t fail_depth;
+} lone_entry_t;
+
+typedef struct {
+  bool *cancel_search;
+  bool canceled;
+
+  // Set once a draw by repetition is reached, until the node that started
+  // searching the draw returns.
+  bool repetition;
+
+  // Results of the previously solved positions. Since the positions are
+  // solved again for every depth, most of the work is remembered from the
+  // previous depths and the previous calls of the search.
+  lone_entry_t table[LONE_TABLE_SIZE];
+} lone_solver_t;
+
+// Kept out of the stack, as the solver may be called deep inside a search.
+static __thread lone_solver_t thread_solver;
+
+// Check if a lone piece can reach the center in the given number of moves,
+// ignoring the other pieces on the board.
+// Pawns move 1 square or jump 2 squares with a capture, knights move 2 squares
+// or jump 3 squares with a capture.
+static inline bool can_reach_center(pos_t position, bool is_knight,
+                                    size_t moves) {
+  const uint64_t *move_table = n_table[is_knight ? 2 : 1];
+  const uint64_t *capture_table = n_table[is_knight ? 3 : 2];
+
+  uint64_t reached_bb = 1ull << position;
+  uint64_t frontier_bb = reached_bb;
+
+  for (size_t i = 0; i < moves && frontier_bb; i++) {
+    if (reached_bb & center_squares_bb)
+      return true;
+
+    uint64_t next_bb = 0;
+    while (frontier_bb) {
+      pos_t new_pos = __builtin_ctzl(frontier_bb);
+      frontier_bb &= ~(1ull << new_pos);
+
+      next_bb |= move_table[new_pos] | capture_table[new_pos];
+    }
+
+    frontier_bb = next_bb & ~reached_bb;
+    reached_bb |= next_bb;
+  }
+
+  return reached_bb & center_squares_bb;
+}
+
+// Check if the attacker can not possibly win in the given number of plies.
+// A lone player can only win by moving its piece into the center, or by
+// capturing all of the opponent pieces.
+static inline bool is_lone_win_impossible(board_state_t *state, bool attacker,
+                                          size_t depth) {
+  unsigned int attacker_count =
+      attacker ? state->white_count : state->black_count;
+  unsigned int defender_count =
+      attacker ? state->black_count : state->white_count;
+
+  if (attacker_count != 1)
+    return false;
+
+  size_t attacker_moves = (depth + (state->turn == attacker)) / 2;
+  if (defender_count <= attacker_moves)
+    return false;
+
+  uint64_t piece_bb = attacker ? state->pieces_bb[0] | state->pieces_bb[1]
+                               : state->pieces_bb[2] | state->pieces_bb[3];
+  pos_t position = __builtin_ctzl(piece_bb);
+
+  // A lone piece is in an island only if it is on a center square.
+  if (state->islands_bb & piece_bb)
+    return false;
+
+  return !can_reach_center(
+      position, get_piece_type(state->board[position]) == MOD_KNIGHT,
+      attacker_moves);
+}
+
+// Check if the attacker can force a win in at most depth plies.
+// The table ignores how the position was reached, so the results that depended
+// on a draw by repetition are not remembered.
+static bool _lone_win(lone_solver_t *solver, board_state_t *state,
+                      history_t *history, bool attacker, size_t depth) {
+  switch (state->status & 0x30) {
+  case 0x10:
+    if (state->status == DRAW_BY_REPETITION)
+      solver->repetition = true;
+    return false;
+  case 0x20:
+    return attacker;
+  case 0x30:
+    return !attacker;
+  }
+
+  if (!depth)
+    return false;
+
+  if (__atomic_load_n(solver->cancel_search, __ATOMIC_RELAXED)) {
+    solver->canceled = true;
+    return false;
+  }
+
+#ifdef MEASURE_EVAL_COUNT
+  measure_count.lone_solver_count++;
+#endif
+
+  if (is_lone_win_impossible(state, attacker, depth))
+    return false;
+
+  lone_entry_t *entry = &solver->table[state->hash % LONE_TABLE_SIZE];
+  bool found = entry->hash == state->hash && entry->turn == state->turn &&
+               entry->attacker == attacker;
+
+  if (found) {
+    if (entry->win_depth && entry->win_depth <= depth)
+      return true;
+    if (depth <= entry->fail_depth)
+      return false;
+  }
+
+  move_t moves[256];
+  generate_moves(state, moves);
+
+  // If the defender is a lone piece that can move into the center, the
+  // attacker can not win.
+  bool attacker_turn = state->turn == attacker;
+  if (!attacker_turn &&
+      (attacker ? state->black_count : state->white_count) == 1) {
+    for (size_t i = 0; is_valid_move(moves[i]); i++) {
+      if (is_center(moves[i].to))
+        return false;
+    }
+  }
+
+  bool outer_repetition = solver->repetition;
+  solver->repetition = false;
+
+  // If it is the attackers turn, one winning move is enough. Otherwise, all of
+  // the moves must be winning. No moves means draw.
+  bool result = is_valid_move(moves[0]) && !attacker_turn;
+  for (size_t i = 0; is_valid_move(moves[i]); i++) {
+    do_move(state, history, moves[i]);
+    bool win = _lone_win(solver, state, history, attacker, depth - 1);
+    undo_last_move(state, history);
+
+    if (solver->canceled)
+      return false;
+
+    if (win == attacker_turn) {
+      result = win;
+      break;
+    }
+  }
+
+  if (solver->repetition)
+    return result;
+  solver->repetition = outer_repetition;
+
+  if (!found)
+    *entry = (lone_entry_t){
+        .hash = state->hash, .turn = state->turn, .attacker = attacker};
+
+  if (result) {
+    if (!entry->win_depth || depth < entry->win_depth)
+      entry->win_depth = depth;
+  } else if (depth > entry->fail_depth) {
+    entry->fail_depth = depth;
+  }
+
+  return result;
+}
+
+// Forget the results of the previous searches of the calling thread.
+void clear_lone_solver() {
+  memset(thread_solver.table, 0, sizeof(thread_solver.table));
+}
+
+// Get the least number of plies the winner needs to win, at most max_depth.
+// Returns LONE_NO_WIN if the winner can not force a win in max_depth plies.
+static size_t _lone_win_depth(lone_solver_t *solver, board_state_t *state,
+                              history_t *history, bool winner,
+                              size_t max_depth) {
+  for (size_t depth = 0; depth <= max_depth; depth++) {
+    if (_lone_win(solver, state, history, winner, depth))
+      return depth;
+  }
+
+  return LONE_NO_WIN;
+}
+
+// Find the exact mate distance of a position where either player is down to a
+// single piece, and the moves that lead to it.
+// The winner plays the moves that win the fastest, and the loser plays the
+// moves that lose the slowest.
+// Returns EVAL_INVALID if neither player can force a win in max_depth plies,
+// or if the search is canceled.
+eval_t lone_solve(board_state_t *state, history_t *history,
+                  bool *cancel_search, size_t max_depth, move_t *best_moves) {
+  thread_solver.cancel_search = cancel_search;
+  thread_solver.canceled = false;
+  thread_solver.repetition = false;
+
+  if (max_depth > UINT8_MAX)
+    max_depth = UINT8_MAX;
+
+  // Iterate the depths, so that the first win found is the fastest one.
+  // Check the side to move first, as it is the one that is more likely to win.
+  size_t depth = 0;
+  bool winner;
+  for (size_t i = 1; i <= max_depth && !depth; i++) {
+    if (_lone_win(&thread_solver, state, history, state->turn, i)) {
+      depth = i;
+      winner = state->turn;
+    } else if (_lone_win(&thread_solver, state, history, !state->turn, i)) {
+      depth = i;
+      winner = !state->turn;
+    }
+
+    if (thread_solver.canceled)
+      return EVAL_INVALID;
+  }
+
+  if (!depth)
+    return EVAL_INVALID;
+
+  if (best_moves) {
+    move_t moves[256];
+    generate_moves(state, moves);
+
+    size_t length = 0;
+    size_t best_depth = 0;
+    for (size_t i = 0; is_valid_move(moves[i]); i++) {
+      do_move(state, history, moves[i]);
+      size_t move_depth =
+          _lone_win_depth(&thread_solver, state, history, winner, depth - 1);
+      undo_last_move(state, history);
+
+      if (thread_solver.canceled)
+        return EVAL_INVALID;
+
+      // Moves of the winner that do not win in depth - 1 plies are not
+      // winning the fastest.
+      if (move_depth == LONE_NO_WIN)
+        continue;
+
+      if (length && (state->turn == winner ? move_depth > best_depth
+                                           : move_depth < best_depth))
+        continue;
+
+      if (!length || move_depth != best_depth)
+        length = 0;
+
+      best_moves[length++] = moves[i];
+      best_depth = move_depth;
+    }
+    best_moves[length] = MOVE_INV;
+  }
+
+  size_t mate_size = history->size + depth;
+  return winner ? EVAL_WHITE_MATES - mate_size : EVAL_BLACK_MATES + mate_size;
+}
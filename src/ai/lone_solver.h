@@ -0,0 +1,36 @@
+/*
+This file is part of JazzInSea.
+
+JazzInSea is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+JazzInSea is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+JazzInSea. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _AI_LONE_SOLVER_H
+#define _AI_LONE_SOLVER_H
+
+#include "ai/eval_t.h"
+#include "move/move_t.h"
+#include "state/board_state_t.h"
+#include "state/history.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Check if either of the players is down to a single piece.
+static inline bool is_lone_position(board_state_t *state) {
+  return state->white_count == 1 || state->black_count == 1;
+}
+
+void clear_lone_solver();
+eval_t lone_solve(board_state_t *, history_t *, bool *, size_t, move_t *);
+
+#endif
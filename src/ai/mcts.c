@@ -0,0 +1,343 @@
+/*
+This file is part of JazzInSea.
+
+JazzInSea is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+JazzInSea is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+JazzInSea. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "ai/mcts.h"
+#include "ai/cache.h"
+#include "ai/eval_t.h"
+#include "ai/iterative_deepening.h"
+#include "ai/mcts_tree.h"
+#include "ai/measure_count.h"
+#include "ai/position_evaluation.h"
+#include "ai/time_manager.h"
+#include "board/status_t.h"
+#include "io/pp.h"
+#include "move/generation.h"
+#include "move/make_move.h"
+#include "move/move_t.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Largest number of moves a playout makes inside the tree.
+#define MCTS_MAX_PATH 256
+
+// xorshift64* generator, every thread has its own state in its cache.
+static inline uint64_t mcts_random(ai_cache_t *cache) {
+  uint64_t x = cache->mcts_random;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  cache->mcts_random = x;
+  return x * 0x2545f4914f6cdd1dull;
+}
+
+// Get the result of a game in half points for white.
+static inline uint32_t game_result(board_state_t *state) {
+  switch (state->status & 0x30) {
+  case 0x20:
+    return 2;
+  case 0x30:
+    return 0;
+  default:
+    return 1;
+  }
+}
+
+// Play random moves until the game ends or mcts_playout_depth moves are
+// played. Unfinished games are decided by the position evaluation.
+// Returns the result in half points for white.
+static uint32_t _mcts_playout(board_state_t *state, history_t *history,
+                              ai_cache_t *cache) {
+  size_t plies = 0;
+  uint32_t result;
+
+  while (true) {
+    if (state->status != NORMAL) {
+      result = game_result(state);
+      break;
+    }
+
+    if (plies == cache->mcts_playout_depth) {
+      int evaluation = get_board_evaluation(state, cache);
+      if (evaluation > cache->mcts_draw_margin)
+        result = 2;
+      else if (evaluation < -cache->mcts_draw_margin)
+        result = 0;
+      else
+        result = 1;
+      break;
+    }
+
+    move_t moves[256];
+    generate_moves(state, moves);
+
+    size_t length = 0;
+    while (is_valid_move(moves[length]))
+      length++;
+
+    // No moves is a draw.
+    if (!length) {
+      result = 1;
+      break;
+    }
+
+    do_move(state, history, moves[mcts_random(cache) % length]);
+    plies++;
+  }
+
+  for (; plies; plies--)
+    undo_last_move(state, history);
+
+  return result;
+}
+
+// Select the child with the highest upper confidence bound.
+// Children that were never visited are selected first.
+static mcts_node_t *_mcts_select(ai_cache_t *cache, mcts_node_t *node) {
+  double log_visits =
+      log(__atomic_load_n(&node->visits, __ATOMIC_RELAXED) + 1);
+  double exploration = cache->mcts_exploration / 100.0;
+
+  mcts_node_t *best_child = &node->children[0];
+  double best_value = -1;
+
+  for (size_t i = 0; i < node->child_count; i++) {
+    mcts_node_t *child = &node->children[i];
+    uint32_t visits = __atomic_load_n(&child->visits, __ATOMIC_RELAXED);
+    uint32_t score = __atomic_load_n(&child->score, __ATOMIC_RELAXED);
+
+    if (!visits)
+      return child;
+
+    double value =
+        score / (2.0 * visits) + exploration * sqrt(log_visits / visits);
+
+    if (value > best_value) {
+      best_value = value;
+      best_child = child;
+    }
+  }
+
+  return best_child;
+}
+
+// Allocate the children of the node. Only one thread expands a node, the
+// other threads run their playouts from the node until it is expanded.
+static void _mcts_expand(board_state_t *state, ai_cache_t *cache,
+                         mcts_node_t *node) {
+  uint8_t expected = MCTS_UNEXPANDED;
+  if (!__atomic_compare_exchange_n(&node->expansion, &expected, MCTS_EXPANDING,
+                                   false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    return;
+
+  move_t moves[256];
+  generate_moves(state, moves);
+
+  size_t length = 0;
+  while (is_valid_move(moves[length]))
+    length++;
+
+  mcts_node_t *children = NULL;
+  if (length) {
+    children = alloc_mcts_nodes(cache->mcts_tree, length);
+
+    // The pool is full, the search is about to stop.
+    if (!children) {
+      __atomic_store_n(&node->expansion, MCTS_UNEXPANDED, __ATOMIC_RELEASE);
+      return;
+    }
+  }
+
+  for (size_t i = 0; i < length; i++)
+    children[i] = (mcts_node_t){.move = moves[i]};
+
+  node->children = children;
+  node->child_count = length;
+  __atomic_store_n(&node->expansion, MCTS_EXPANDED, __ATOMIC_RELEASE);
+}
+
+// Monte Carlo tree search with UCT. All of the threads share the tree in
+// cache->mcts_tree. A thread going down a node adds mcts_virtual_loss lost
+// visits to it, so that the other threads spread to the other nodes until
+// its playout is finished.
+// Searches until the search is canceled or the node pool is full, max_depth is
+// not used. Only the main thread selects the best moves.
+void *_mcts_routine(void *r_args) {
+  _id_routine_args_t *args = (_id_routine_args_t *)r_args;
+
+  board_state_t *state = args->state;
+  history_t *history = args->history;
+  ai_cache_t *cache = args->cache;
+  move_t *best_moves = args->best_moves;
+  eval_t *evaluation = args->evaluation;
+  bool main_thread = !args->thread_id;
+
+  mcts_tree_t *tree = cache->mcts_tree;
+  mcts_node_t *root = &tree->root;
+
+  if (main_thread) {
+    io_debug();
+    pp_f("debug: calling _mcts_routine for color %s\n",
+         state->turn ? "white" : "black");
+    pp_board(state->board);
+  }
+
+  move_t moves[256];
+  generate_moves(state, moves);
+
+  // If there are no moves available, return draw by no moves.
+  if (!is_valid_move(moves[0])) {
+    best_moves[0] = MOVE_INV;
+    *evaluation = EVAL_INVALID;
+    return NULL;
+  }
+
+  // If there is only one move available, return that only move.
+  if (!is_valid_move(moves[1])) {
+    best_moves[0] = moves[0];
+    best_moves[1] = MOVE_INV;
+    *evaluation = EVAL_INVALID;
+    return NULL;
+  }
+
+  mcts_node_t *path[MCTS_MAX_PATH];
+  bool movers[MCTS_MAX_PATH];
+
+  while (!is_search_stopped(cache) &&
+         !__atomic_load_n(&tree->pool_full, __ATOMIC_RELAXED)) {
+    mcts_node_t *node = root;
+    size_t length = 0;
+
+    // Go down the tree until a leaf or a game end.
+    while (state->status == NORMAL && length < MCTS_MAX_PATH) {
+      if (__atomic_load_n(&node->expansion, __ATOMIC_ACQUIRE) !=
+          MCTS_EXPANDED) {
+        if (node == root || __atomic_load_n(&node->visits, __ATOMIC_RELAXED) >=
+                                cache->mcts_expand_visits)
+          _mcts_expand(state, cache, node);
+        break;
+      }
+
+      if (!node->child_count)
+        break;
+
+      mcts_node_t *child = _mcts_select(cache, node);
+      __atomic_add_fetch(&child->visits, cache->mcts_virtual_loss,
+                         __ATOMIC_RELAXED);
+
+      movers[length] = state->turn;
+      do_move(state, history, child->move);
+      path[length++] = child;
+      node = child;
+    }
+
+    uint32_t result = _mcts_playout(state, history, cache);
+
+#ifdef MEASURE_EVAL_COUNT
+    measure_count.mcts_playout_count++;
+#endif
+
+    // Replace the virtual losses with the result.
+    while (length--) {
+      undo_last_move(state, history);
+      __atomic_add_fetch(&path[length]->score,
+                         movers[length] ? result : 2 - result,
+                         __ATOMIC_RELAXED);
+      __atomic_add_fetch(&path[length]->visits, 1 - cache->mcts_virtual_loss,
+                         __ATOMIC_RELAXED);
+    }
+    __atomic_add_fetch(&root->visits, 1, __ATOMIC_RELAXED);
+
+    // The main thread stops at the soft time limit, the other threads are
+    // stopped after it returns.
+    if (main_thread && is_time_managed(&cache->time_manager) &&
+        get_elapsed_ms(&cache->time_manager) >= cache->time_manager.soft_ms)
+      break;
+  }
+
+  if (!main_thread)
+    return NULL;
+
+  if (__atomic_load_n(&root->expansion, __ATOMIC_ACQUIRE) != MCTS_EXPANDED) {
+    io_debug();
+    pp_f("[search canceled]\n");
+    return NULL;
+  }
+
+  // The other threads are still running their playouts, so the visits and the
+  // scores are read atomically.
+  uint32_t visits[256];
+  uint32_t scores[256];
+  for (size_t i = 0; i < root->child_count; i++) {
+    visits[i] = __atomic_load_n(&root->children[i].visits, __ATOMIC_RELAXED);
+    scores[i] = __atomic_load_n(&root->children[i].score, __ATOMIC_RELAXED);
+  }
+
+  // Print the visits and the scores of the moves.
+  io_debug();
+  pp_f("playouts=%u, { ", __atomic_load_n(&root->visits, __ATOMIC_RELAXED));
+  for (size_t i = 0; i < root->child_count; i++) {
+    pp_move(root->children[i].move);
+    pp_f(": %u/%u, ", scores[i], 2 * visits[i]);
+  }
+  pp_f("}\n");
+
+  // A move that wins the game right away is always the best move.
+  size_t length = 0;
+  for (size_t i = 0; i < root->child_count; i++) {
+    do_move(state, history, root->children[i].move);
+    bool win = state->status != NORMAL &&
+               game_result(state) == (state->turn ? 0 : 2);
+    undo_last_move(state, history);
+
+    if (win)
+      best_moves[length++] = root->children[i].move;
+  }
+
+  if (length) {
+    best_moves[length] = MOVE_INV;
+
+    size_t mate_size = history->size + 1;
+    *evaluation = state->turn ? EVAL_WHITE_MATES - mate_size
+                              : EVAL_BLACK_MATES + mate_size;
+    return NULL;
+  }
+
+  // Otherwise, select the most visited moves.
+  size_t best = 0;
+  for (size_t i = 0; i < root->child_count; i++) {
+    if (length && visits[i] == visits[best]) {
+      best_moves[length++] = root->children[i].move;
+    } else if (!length || visits[i] > visits[best]) {
+      length = 1;
+      best_moves[0] = root->children[i].move;
+      best = i;
+    }
+  }
+  best_moves[length] = MOVE_INV;
+
+  // Convert the score of the best move to an evaluation, from the view of
+  // white.
+  double score = visits[best] ? scores[best] / (2.0 * visits[best]) : 0.5;
+  if (!state->turn)
+    score = 1 - score;
+
+  *evaluation = (2 * score - 1) * cache->mcts_eval_scale;
+
+  return NULL;
+}
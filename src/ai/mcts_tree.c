@@ -0,0 +1,34 @@
+/*
+This file is part of JazzInSea.
+
+JazzInSea is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+JazzInSea is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+JazzInSea. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "ai/mcts_tree.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+// Returns false if the node pool can not be allocated.
+bool setup_mcts_tree(mcts_tree_t *tree, size_t pool_capacity) {
+  tree->root = (mcts_node_t){.expansion = MCTS_UNEXPANDED};
+  tree->pool = malloc(sizeof(mcts_node_t) * pool_capacity);
+  tree->pool_size = 0;
+  tree->pool_capacity = pool_capacity;
+  tree->pool_full = false;
+
+  return tree->pool;
+}
+
+void free_mcts_tree(mcts_tree_t *tree) { free(tree->pool); }
@@ -0,0 +1,83 @@
+/*
+This file is part of JazzInSea.
+
+JazzInSea is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+JazzInSea is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+JazzInSea. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _AI_MCTS_TREE_H
+#define _AI_MCTS_TREE_H
+
+#include "move/move_t.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+  MCTS_UNEXPANDED,
+
+  // A thread is allocating the children of the node.
+  MCTS_EXPANDING,
+
+  // The children of the node are allocated and can be selected.
+  MCTS_EXPANDED,
+} mcts_expansion_t;
+
+typedef struct mcts_node_t {
+  // The children of the node, consecutive in the node pool.
+  struct mcts_node_t *children;
+  uint16_t child_count;
+  uint8_t expansion;
+
+  // The move that leads to the node.
+  move_t move;
+
+  // Number of playouts through the node, including the virtual losses of the
+  // playouts that are still running.
+  uint32_t visits;
+
+  // Sum of the results of the playouts in half points, from the view of the
+  // player that played the move. A win is 2 points, a draw is 1 point.
+  uint32_t score;
+} mcts_node_t;
+
+// The search tree shared by all of the search threads.
+typedef struct {
+  mcts_node_t root;
+
+  // Preallocated nodes, given out in blocks of children.
+  mcts_node_t *pool;
+  size_t pool_size;
+  size_t pool_capacity;
+
+  // Set when a block of children did not fit into the pool.
+  bool pool_full;
+} mcts_tree_t;
+
+bool setup_mcts_tree(mcts_tree_t *, size_t);
+void free_mcts_tree(mcts_tree_t *);
+
+// Allocate a block of count nodes from the pool.
+// Returns NULL if the pool does not have enough nodes left.
+static inline mcts_node_t *alloc_mcts_nodes(mcts_tree_t *tree, size_t count) {
+  size_t index = __atomic_fetch_add(&tree->pool_size, count, __ATOMIC_RELAXED);
+
+  if (index + count > tree->pool_capacity) {
+    __atomic_store_n(&tree->pool_full, true, __ATOMIC_RELAXED);
+    return NULL;
+  }
+
+  return &tree->pool[index];
+}
+
+#endif
@@ -18,16 +18,15 @@ JazzInSea. If not, see <https://www.gnu.org/licenses/>.
 #include <stddef.h>
 
 #ifdef MEASURE_EVAL_COUNT
-size_t position_evaluation_count = 0;
-size_t move_generation_count = 0;
+__thread measure_count_t measure_count;
 
-size_t evaluate_count = 0;
-size_t game_end_count = 0;
-size_t leaf_count = 0;
-size_t ab_branch_cut_count = 0;
+// Add the counters of source to destination.
+void add_measure_count(measure_count_t *destination,
+                       const measure_count_t *source) {
+  size_t *destination_counts = (size_t *)destination;
+  const size_t *source_counts = (const size_t *)source;
 
-size_t tt_remember_count = 0;
-size_t tt_saved_count = 0;
-size_t tt_overwritten_count = 0;
-size_t tt_rewritten_count = 0;
+  for (size_t i = 0; i < sizeof(measure_count_t) / sizeof(size_t); i++)
+    destination_counts[i] += source_counts[i];
+}
 #endif
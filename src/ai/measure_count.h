@@ -19,19 +19,75 @@ JazzInSea. If not, see <https://www.gnu.org/licenses/>.
 
 #include <stddef.h>
 
+// Late move reductions of this many plies or more are counted together.
+#define LMR_STATS 5
+
 #ifdef MEASURE_EVAL_COUNT
-extern size_t position_evaluation_count;
-extern size_t move_generation_count;
-
-extern size_t evaluate_count;
-extern size_t game_end_count;
-extern size_t leaf_count;
-extern size_t ab_branch_cut_count;
-
-extern size_t tt_remember_count;
-extern size_t tt_saved_count;
-extern size_t tt_overwritten_count;
-extern size_t tt_rewritten_count;
+// All of the counters must be of type size_t, as the structure is summed as an
+// array of size_t values.
+typedef struct {
+  size_t position_evaluation_count;
+  size_t move_generation_count;
+
+  // Moves picked as hash moves, killer moves or countermoves without scoring,
+  // and the moves scored by the move pickers.
+  size_t picked_hash_move_count;
+  size_t picked_killer_count;
+  size_t scored_move_count;
+
+  size_t evaluate_count;
+  size_t game_end_count;
+  size_t leaf_count;
+  size_t ab_branch_cut_count;
+  size_t first_move_cut_count;
+  size_t split_count;
+  size_t pvs_research_count;
+  size_t aspiration_fail_low_count;
+  size_t aspiration_fail_high_count;
+
+  size_t futility_prune_count;
+  size_t razoring_cut_count;
+  size_t late_move_prune_count;
+
+  // Late move reductions by the number of plies reduced, and the reduced
+  // searches that were searched again at full depth.
+  size_t late_move_reduction_counts[LMR_STATS];
+  size_t late_move_research_count;
+
+  size_t probcut_try_count;
+  size_t probcut_cut_count;
+  size_t multi_cut_count;
+  size_t iid_count;
+
+  size_t null_move_cut_count;
+  size_t null_move_fail_count;
+
+  size_t quiescence_count;
+  size_t quiescence_leaf_count;
+  size_t quiescence_cut_count;
+
+  size_t lone_solver_count;
+  size_t lone_solved_count;
+  size_t dfpn_count;
+
+  size_t mcts_playout_count;
+
+  size_t tt_remember_count;
+
+  // Probed entries of the board with enough depth, and the entries that could
+  // be used, by node_type_t.
+  size_t tt_probe_counts[3];
+  size_t tt_hit_counts[3];
+  size_t tt_saved_count;
+  size_t tt_overwritten_count;
+  size_t tt_rewritten_count;
+} measure_count_t;
+
+// Every search thread counts on its own copy, so that the threads do not fight
+// over the same cache lines.
+extern __thread measure_count_t measure_count;
+
+void add_measure_count(measure_count_t *, const measure_count_t *);
 #endif
 
 #endif
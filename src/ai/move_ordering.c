@@ -17,6 +17,7 @@ JazzInSea. If not, see <https://www.gnu.org/licenses/>.
 #include "ai/move_ordering.h"
 #include "ai/cache.h"
 #include "ai/eval_t.h"
+#include "ai/measure_count.h"
 #include "ai/position_evaluation.h"
 #include "ai/transposition_table.h"
 #include "board/board_t.h"
@@ -36,51 +37,102 @@ int cmp_short_eval_move(const void *a, const void *b) {
   return (a_s.eval > b_s.eval) - (a_s.eval < b_s.eval);
 }
 
-bool check_for_killer_move(move_t move, move_t *killer_moves) {
-  for (int i = 0; is_valid_move(killer_moves[i]); i++) {
-    if (compare_move(killer_moves[i], move)) {
-      return true;
-    }
+// Remember a move that cut the node at the end of the history, in the killer
+// moves, the history scores and the countermoves. Only quiet moves are
+// remembered. Captures are forced, so the nodes with captures never use them.
+void add_cut_move(ai_cache_t *cache, history_t *history, bool turn,
+                  move_t move, size_t depth) {
+  if (is_capture(move))
+    return;
+
+  move_t *killer_moves = get_killer_moves(cache, history);
+  if (!compare_move(killer_moves[0], move)) {
+    killer_moves[1] = killer_moves[0];
+    killer_moves[0] = move;
   }
-  return false;
+
+  int *score = &cache->history_scores[turn][move.from][move.to];
+  *score += depth * depth;
+  if (*score >= HISTORY_SCORE_MAX)
+    age_history_scores(cache);
+
+  if (history->size) {
+    move_t last_move = history->history[history->size - 1].move;
+    if (is_valid_move(last_move))
+      cache->countermoves[turn][last_move.from][last_move.to] = move;
+  }
+}
+
+// Halve all of the history scores, so that the recent cuts weigh more.
+void age_history_scores(ai_cache_t *cache) {
+  int *scores = &cache->history_scores[0][0][0];
+  for (size_t i = 0; i < sizeof(cache->history_scores) / sizeof(int); i++)
+    scores[i] /= 2;
+}
+
+// Estimate the evaluation after the move, from the short evaluation of the
+// move and the moves that cut the other nodes.
+static inline eval_t _estimate_move(board_state_t *state, ai_cache_t *cache,
+                                    move_t move, move_t *killer_moves,
+                                    move_t countermove,
+                                    int (*history_scores)[64]) {
+  eval_t short_evaluation = get_short_move_evaluation(state, cache, move);
+
+  // Moves that cut the siblings or the other nodes are likely to cut this
+  // node as well.
+  int bonus = history_scores[move.from][move.to] *
+              cache->est_evaluation_history / HISTORY_SCORE_MAX;
+
+  if (compare_move(move, killer_moves[0]) ||
+      compare_move(move, killer_moves[1]))
+    bonus += cache->est_evaluation_killer;
+
+  if (compare_move(move, countermove))
+    bonus += cache->est_evaluation_countermove;
+
+  return short_evaluation * cache->est_evaluation_pos +
+         (state->turn ? bonus : -bonus);
 }
 
-void order_moves(board_state_t *state, ai_cache_t *cache, move_t *moves,
-                 bool descending, move_t *killer_moves) {
+// Order all of the moves, by their estimates and the old evaluations of the
+// positions after them in the transposition table. Used on the root, where
+// every move is searched.
+void order_moves(board_state_t *state, history_t *history, ai_cache_t *cache,
+                 move_t *moves, bool descending) {
   move_eval_pair_t eval_moves[256];
 
+  move_t *killer_moves = get_killer_moves(cache, history);
+  move_t countermove = get_countermove(cache, history, state->turn);
+  int(*history_scores)[64] = cache->history_scores[state->turn];
+
   // Copy moves to new buffer to be sorted.
   size_t i;
   for (i = 0; is_valid_move(moves[i]); i++) {
     move_t move = moves[i];
 
     piece_t piece = state->board[move.from];
-    tt_entry_t *entry = get_entry_tt(
-        cache, state->hash ^ get_hash_for_move(state, piece, move));
+    tt_entry_t entry;
+    if (!find_entry_tt(cache,
+                       state->hash ^ get_hash_for_move(state, piece, move),
+                       &entry))
+      entry = (tt_entry_t){.eval = 0, .depth = 0};
 
     eval_t estimate_evaluation;
-    if (is_mate(entry->eval)) {
-      estimate_evaluation = entry->eval;
+    if (is_mate(entry.eval)) {
+      estimate_evaluation = entry.eval;
     } else {
-      // Calculate estimate evaluation using a linear combination of short
-      // evaluation and old evaluation.
-      eval_t short_evaluation = get_short_move_evaluation(state, cache, move);
-
+      // Calculate estimate evaluation using a linear combination of the
+      // estimate and old evaluation.
       estimate_evaluation =
-          entry->eval * entry->depth * cache->est_evaluation_old +
-          short_evaluation * cache->est_evaluation_pos;
-
-      // Check if this move was a killer move in a sibling.
-      if (check_for_killer_move(move, killer_moves)) {
-        estimate_evaluation += state->turn ? cache->est_evaluation_killer
-                                           : -cache->est_evaluation_killer;
-      }
+          entry.eval * entry.depth * cache->est_evaluation_old +
+          _estimate_move(state, cache, move, killer_moves, countermove,
+                         history_scores);
     }
 
     // Negate the evaluation score to create the effect of reversing the output.
     eval_moves[i] = (move_eval_pair_t){
         .eval = descending ? -estimate_evaluation : estimate_evaluation,
-        .move = move,
+        .move = moves[i],
     };
   }
 
@@ -93,3 +145,137 @@ void order_moves(board_state_t *state, ai_cache_t *cache, move_t *moves,
     moves[i] = eval_moves[i].move;
   }
 }
+
+// Start picking the moves of a MOVE_INV terminated array of moves. The hash
+// move is picked first if it is one of the moves.
+// The killer moves are only tried first on quiet nodes, the few captures are
+// cheap to score.
+void setup_move_picker(move_picker_t *picker, move_t *moves,
+                       move_t hash_move) {
+  size_t count = 0;
+  while (is_valid_move(moves[count]))
+    count++;
+
+  picker->stage = PICK_HASH_MOVE;
+  picker->captures = count && is_capture(moves[0]);
+  picker->hash_move = hash_move;
+  picker->count = count;
+  picker->picked = 0;
+  picker->killer_index = 0;
+}
+
+// Pick the move at index, and move it to the end of the picked moves.
+static inline void _pick_index(move_picker_t *picker, move_t *moves,
+                               size_t index) {
+  size_t picked = picker->picked++;
+
+  move_t move = moves[index];
+  moves[index] = moves[picked];
+  moves[picked] = move;
+
+  eval_t score = picker->scores[index];
+  picker->scores[index] = picker->scores[picked];
+  picker->scores[picked] = score;
+}
+
+// Pick the moves until moves[index] is picked. Moves are picked in order, so
+// index is at most the number of picked moves.
+// Returns false if there are no moves left to pick.
+bool pick_move(board_state_t *state, history_t *history, ai_cache_t *cache,
+               move_picker_t *picker, move_t *moves, size_t index) {
+  assert(index <= picker->picked);
+
+  if (index < picker->picked)
+    return true;
+
+  if (picker->picked >= picker->count)
+    return false;
+
+  switch (picker->stage) {
+  case PICK_HASH_MOVE:
+    picker->stage = PICK_KILLERS;
+
+    if (is_valid_move(picker->hash_move)) {
+      for (size_t i = picker->picked; i < picker->count; i++) {
+        if (compare_move(moves[i], picker->hash_move)) {
+#ifdef MEASURE_EVAL_COUNT
+          measure_count.picked_hash_move_count++;
+#endif
+          _pick_index(picker, moves, i);
+          return true;
+        }
+      }
+    }
+    // fall through
+
+  case PICK_KILLERS: {
+    move_t *killer_moves = get_killer_moves(cache, history);
+
+    // Only moves that are in the moves array are picked, since the killer
+    // moves of the ply may not be legal on this node.
+    while (!picker->captures && picker->killer_index < 3) {
+      move_t move = picker->killer_index < 2
+                        ? killer_moves[picker->killer_index]
+                        : get_countermove(cache, history, state->turn);
+      picker->killer_index++;
+
+      if (!is_valid_move(move))
+        continue;
+
+      for (size_t i = picker->picked; i < picker->count; i++) {
+        if (compare_move(moves[i], move)) {
+#ifdef MEASURE_EVAL_COUNT
+          measure_count.picked_killer_count++;
+#endif
+          _pick_index(picker, moves, i);
+          return true;
+        }
+      }
+    }
+
+    picker->stage = PICK_SCORE;
+  }
+    // fall through
+
+  case PICK_SCORE: {
+    move_t *killer_moves = get_killer_moves(cache, history);
+    move_t countermove = get_countermove(cache, history, state->turn);
+    int(*history_scores)[64] = cache->history_scores[state->turn];
+
+    for (size_t i = picker->picked; i < picker->count; i++) {
+      eval_t estimate_evaluation = _estimate_move(
+          state, cache, moves[i], killer_moves, countermove, history_scores);
+      picker->scores[i] =
+          state->turn ? estimate_evaluation : -estimate_evaluation;
+    }
+
+#ifdef MEASURE_EVAL_COUNT
+    measure_count.scored_move_count += picker->count - picker->picked;
+#endif
+
+    picker->stage = PICK_SCORED;
+  }
+    // fall through
+
+  case PICK_SCORED: {
+    // Select the best move left, the moves after a cutoff are never sorted.
+    size_t best = picker->picked;
+    for (size_t i = best + 1; i < picker->count; i++) {
+      if (picker->scores[i] > picker->scores[best])
+        best = i;
+    }
+
+    _pick_index(picker, moves, best);
+    return true;
+  }
+  }
+
+  return false;
+}
+
+// Pick all of the remaining moves, so that the whole moves array is ordered.
+void pick_all_moves(board_state_t *state, history_t *history,
+                    ai_cache_t *cache, move_picker_t *picker, move_t *moves) {
+  while (pick_move(state, history, cache, picker, moves, picker->picked))
+    ;
+}
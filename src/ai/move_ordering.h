@@ -19,14 +19,54 @@ JazzInSea. If not, see <https://www.gnu.org/licenses/>.
 
 #include "ai/cache.h"
 #include "ai/eval_t.h"
+#include "ai/move_picker_t.h"
 #include "move/move_t.h"
 #include "state/board_state_t.h"
+#include "state/history.h"
 
 typedef struct {
   move_t move;
   eval_t eval;
 } move_eval_pair_t;
 
-void order_moves(board_state_t *, ai_cache_t *, move_t *, bool, move_t *);
+// Return the killer moves of the nodes at the given ply.
+static inline move_t *get_killer_moves_at(ai_cache_t *cache, size_t ply) {
+  return cache->killer_moves[ply % KILLER_PLIES];
+}
+
+// Return the killer moves of the node at the end of the history.
+static inline move_t *get_killer_moves(ai_cache_t *cache, history_t *history) {
+  return get_killer_moves_at(cache, history->size);
+}
+
+// Check if the move is one of the killer moves of the nodes at the given ply.
+static inline bool is_killer_move(ai_cache_t *cache, size_t ply, move_t move) {
+  move_t *killer_moves = get_killer_moves_at(cache, ply);
+  return compare_move(killer_moves[0], move) ||
+         compare_move(killer_moves[1], move);
+}
+
+// Return the countermove of the last move in the history, MOVE_INV if there
+// is none.
+static inline move_t get_countermove(ai_cache_t *cache, history_t *history,
+                                     bool turn) {
+  if (!history->size)
+    return MOVE_INV;
+
+  move_t last_move = history->history[history->size - 1].move;
+  if (!is_valid_move(last_move))
+    return MOVE_INV;
+
+  return cache->countermoves[turn][last_move.from][last_move.to];
+}
+
+void add_cut_move(ai_cache_t *, history_t *, bool, move_t, size_t);
+void age_history_scores(ai_cache_t *);
+void order_moves(board_state_t *, history_t *, ai_cache_t *, move_t *, bool);
+void setup_move_picker(move_picker_t *, move_t *, move_t);
+bool pick_move(board_state_t *, history_t *, ai_cache_t *, move_picker_t *,
+               move_t *, size_t);
+void pick_all_moves(board_state_t *, history_t *, ai_cache_t *,
+                    move_picker_t *, move_t *);
 
 #endif
@@ -0,0 +1,70 @@
+/*
+This file is part of JazzInSea.
+
+JazzInSea is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+JazzInSea is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+JazzInSea. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _AI_MOVE_PICKER_T_H
+#define _AI_MOVE_PICKER_T_H
+
+#include "ai/eval_t.h"
+#include "move/move_t.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// The stage of a move picker, the moves of the earlier stages are picked
+// first.
+typedef enum {
+  // Pick the move that was the best in an earlier search of the node.
+  PICK_HASH_MOVE,
+
+  // Pick the killer moves and the countermove of the node, without scoring
+  // the moves. Only used on quiet nodes.
+  PICK_KILLERS,
+
+  // Score the moves that are not picked yet.
+  PICK_SCORE,
+
+  // Pick the best scored move each time.
+  PICK_SCORED,
+} pick_stage_t;
+
+// Orders the moves of a node lazily, only as far as they are searched. The
+// picked moves are kept at the front of the moves array, in the order they are
+// picked, so that the moves array can be shared with the split points.
+typedef struct {
+  pick_stage_t stage;
+
+  // Set if the moves are captures. Since captures are mandatory, either all or
+  // none of the moves are captures.
+  bool captures;
+
+  // The move picked first, MOVE_INV if there is none.
+  move_t hash_move;
+
+  // Number of moves in the moves array.
+  size_t count;
+
+  // Number of moves at the front of the moves array that are picked.
+  size_t picked;
+
+  // Number of the killer moves and the countermove that are tried.
+  size_t killer_index;
+
+  // Scores of the moves that are not picked yet, from the point of view of
+  // the player to move.
+  eval_t scores[256];
+} move_picker_t;
+
+#endif
@@ -78,7 +78,7 @@ eval_t get_short_move_evaluation(board_state_t *state, ai_cache_t *cache,
 // Generate a full evaluation score for the current board.
 int get_board_evaluation(board_state_t *state, ai_cache_t *cache) {
 #ifdef MEASURE_EVAL_COUNT
-  position_evaluation_count++;
+  measure_count.position_evaluation_count++;
 #endif
 
   // If players have centered pieces, add centered advantage score.
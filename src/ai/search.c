@@ -16,206 +16,1066 @@ JazzInSea. If not, see <https://www.gnu.org/licenses/>.
 
 #include "ai/search.h"
 #include "ai/eval_t.h"
+#include "ai/lone_solver.h"
 #include "ai/move_ordering.h"
 #include "ai/position_evaluation.h"
+#include "ai/transposition_table.h"
 #include "io/pp.h"
 #include "move/generation.h"
 #include "move/make_move.h"
 #include "move/move_t.h"
 
+#include <assert.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
-// Find the best continuing moves available and their evaluation value.
-eval_t _evaluate(board_state_t *state, history_t *history, ai_cache_t *cache,
-                 size_t max_depth, int old_evaluation, eval_t alpha,
-                 eval_t beta, move_t *killer_moves) {
+// Return the evaluation of the game end if the game should not continue,
+// EVAL_INVALID otherwise.
+static inline eval_t game_end_evaluation(board_state_t *state,
+                                         history_t *history) {
+  switch (state->status & 0x30) {
+  case 0x10:
+#ifdef MEASURE_EVAL_COUNT
+    measure_count.game_end_count++;
+#endif
+    return 0;
+  case 0x20:
+#ifdef MEASURE_EVAL_COUNT
+    measure_count.game_end_count++;
+#endif
+    return EVAL_WHITE_MATES - history->size;
+  case 0x30:
+#ifdef MEASURE_EVAL_COUNT
+    measure_count.game_end_count++;
+#endif
+    return EVAL_BLACK_MATES + history->size;
+  }
+
+  return EVAL_INVALID;
+}
 
-  if (cache->cancel_search) {
+// Continue the search at the horizon with only the capture moves, until the
+// position is quiet.
+// Since captures are mandatory, the side to move can not choose to stand pat
+// while a capture is available. So the static evaluation is only used when
+// there are no captures left, or when the quiescence depth limit is reached.
+static eval_t _quiescence(board_state_t *state, history_t *history,
+                          ai_cache_t *cache, int old_evaluation, eval_t alpha,
+                          eval_t beta, size_t depth) {
+  if (is_search_canceled(cache))
     return EVAL_INVALID;
+
+#ifdef MEASURE_EVAL_COUNT
+  measure_count.quiescence_count++;
+#endif
+
+  {
+    eval_t game_end_eval = game_end_evaluation(state, history);
+    if (game_end_eval != EVAL_INVALID)
+      return game_end_eval;
+  }
+
+  move_t moves[256];
+  generate_captures(state, moves);
+
+  // Stand pat if the position is quiet.
+  if (!is_valid_move(moves[0]) || depth >= cache->quiescence_max_depth) {
+#ifdef MEASURE_EVAL_COUNT
+    measure_count.quiescence_leaf_count++;
+#endif
+
+    return old_evaluation;
+  }
+
+  eval_t best_evaluation = state->turn ? EVAL_BLACK_MATES : EVAL_WHITE_MATES;
+
+  for (int i = 0; is_valid_move(moves[i]); i++) {
+    move_t move = moves[i];
+
+    bool update_islands_table = do_move(state, history, move);
+    int eval_after_move = new_evaluation(state, cache, move, old_evaluation,
+                                         update_islands_table);
+
+    eval_t evaluation = _quiescence(state, history, cache, eval_after_move,
+                                    alpha, beta, depth + 1);
+
+    undo_last_move(state, history);
+
+    if (evaluation == EVAL_INVALID)
+      return EVAL_INVALID;
+
+    if (state->turn ? evaluation <= best_evaluation
+                    : evaluation >= best_evaluation)
+      continue;
+
+    best_evaluation = evaluation;
+
+    if (state->turn) {
+      if (evaluation > beta) {
+#ifdef MEASURE_EVAL_COUNT
+        measure_count.quiescence_cut_count++;
+#endif
+        return best_evaluation;
+      }
+
+      if (evaluation > alpha)
+        alpha = evaluation;
+    } else {
+      if (evaluation < alpha) {
+#ifdef MEASURE_EVAL_COUNT
+        measure_count.quiescence_cut_count++;
+#endif
+        return best_evaluation;
+      }
+
+      if (evaluation < beta)
+        beta = evaluation;
+    }
+  }
+
+  return best_evaluation;
+}
+
+// Check if the last move was a capture.
+static inline bool is_last_move_capture(history_t *history) {
+  if (!history->size)
+    return false;
+
+  move_t move = history->history[history->size - 1].move;
+  return is_valid_move(move) && is_capture(move);
+}
+
+// Check if the last move left the opponent with a single piece.
+static inline bool is_lone_capture(board_state_t *state, history_t *history) {
+  if (!history->size)
+    return false;
+
+  if (!is_last_move_capture(history))
+    return false;
+
+  move_t move = history->history[history->size - 1].move;
+
+  return (get_piece_color(move.capture_piece) == MOD_WHITE
+              ? state->white_count
+              : state->black_count) == 1;
+}
+
+// Check if null move pruning can be used on a node.
+// If the player has to capture, passing the turn is not a similar move. If
+// there are only a few pieces left, the position is likely to be a zugzwang.
+static inline bool can_null_move(board_state_t *state, history_t *history,
+                                 ai_cache_t *cache, move_t *moves,
+                                 size_t max_depth) {
+  if (max_depth < cache->null_move_min_depth)
+    return false;
+
+  if (is_capture(moves[0]))
+    return false;
+
+  if (state->white_count < cache->null_move_min_pieces ||
+      state->black_count < cache->null_move_min_pieces)
+    return false;
+
+  // Do not pass the turn twice in a row.
+  if (history->size &&
+      !is_valid_move(history->history[history->size - 1].move))
+    return false;
+
+  return true;
+}
+
+static eval_t _split(board_state_t *state, history_t *history,
+                     ai_cache_t *cache, move_t *moves, size_t next_move,
+                     size_t max_depth, int old_evaluation, eval_t alpha,
+                     eval_t beta, eval_t best_evaluation, move_t *best_move,
+                     bool *cut);
+
+// Allocate the search stack of a thread. Every frame searches at least one
+// ply less than its parent, except the frames that search a single move.
+void setup_search_stack(ai_cache_t *cache, size_t max_depth) {
+  cache->search_stack_capacity = 2 * (max_depth + 2);
+  cache->search_stack_size = 0;
+  cache->search_stack =
+      malloc(sizeof(search_frame_t) * cache->search_stack_capacity);
+}
+
+void free_search_stack(ai_cache_t *cache) { free(cache->search_stack); }
+
+// Push a new frame on the search stack, that will search a node.
+static inline search_frame_t *
+_push_frame(ai_cache_t *cache, size_t max_depth, int old_evaluation,
+            eval_t alpha, eval_t beta) {
+  assert(cache->search_stack_size < cache->search_stack_capacity);
+
+  search_frame_t *frame = &cache->search_stack[cache->search_stack_size++];
+  frame->stage = STAGE_ENTER;
+  frame->single_move = false;
+  frame->max_depth = max_depth;
+  frame->old_evaluation = old_evaluation;
+  frame->alpha = alpha;
+  frame->beta = beta;
+  frame->best_move = MOVE_INV;
+
+  return frame;
+}
+
+// Return the number of plies to reduce the search of a late move by, from the
+// depth and the index of the move. Moves are reduced less on nodes with an open
+// window, if they are killer moves or have a good history score, and if they
+// are captures or change the islands.
+// The move is already made on the history.
+static inline size_t get_late_move_reduction(ai_cache_t *cache,
+                                             history_t *history,
+                                             search_frame_t *frame,
+                                             move_t move, bool quiet) {
+  size_t new_depth = frame->max_depth - 1;
+  if (frame->index < (size_t)cache->late_move_reduction ||
+      new_depth < (size_t)cache->late_move_min_depth)
+    return 0;
+
+  size_t depth =
+      frame->max_depth < LMR_DEPTHS ? frame->max_depth : LMR_DEPTHS - 1;
+  size_t index = frame->index < LMR_MOVES ? frame->index : LMR_MOVES - 1;
+  int reduction = cache->late_move_reductions[depth][index];
+
+  if (frame->alpha != frame->beta)
+    reduction--;
+
+  if (is_killer_move(cache, history->size - 1, move))
+    reduction--;
+
+  if (cache->history_scores[frame->turn][move.from][move.to] >=
+      cache->late_move_history_threshold)
+    reduction--;
+
+  if (!quiet)
+    reduction--;
+
+  // Always search at least one ply.
+  if (reduction <= 0)
+    return 0;
+  if ((size_t)reduction >= new_depth)
+    return new_depth - 1;
+  return reduction;
+}
+
+// Start searching the move at frame->index.
+// Returns true and sets the evaluation if the move was pruned, or false if a
+// child frame was pushed.
+static inline bool _search_move_begin(board_state_t *state, history_t *history,
+                                      ai_cache_t *cache, search_frame_t *frame,
+                                      eval_t *evaluation) {
+  bool turn = frame->turn;
+  move_t move = frame->moves[frame->index];
+  size_t new_depth = frame->max_depth - 1;
+  eval_t alpha = frame->alpha;
+  eval_t beta = frame->beta;
+
+  // The first move is expected to be the best one, so search the later moves
+  // with a zero width window that only tells if they are better than the
+  // current bound.
+  // Bounds are inclusive, so if a move already reached the bound, test for a
+  // strictly better move. Otherwise a bound returned by the zero width search
+  // could land on the bound and be taken as an exact evaluation.
+  frame->null_window = frame->index > 0;
+  frame->search_alpha = alpha;
+  frame->search_beta = beta;
+  if (frame->null_window) {
+    if (turn)
+      frame->search_alpha = frame->search_beta =
+          frame->best_evaluation >= alpha ? alpha + 1 : alpha;
+    else
+      frame->search_alpha = frame->search_beta =
+          frame->best_evaluation <= beta ? beta - 1 : beta;
+  }
+
+  bool update_islands_table = do_move(state, history, move);
+
+  // Get the new evaluation value after the move.
+  frame->eval_after_move =
+      new_evaluation(state, cache, move, frame->old_evaluation,
+                     update_islands_table);
+
+  // Quiet moves that do not change the islands should not change the
+  // evaluation a lot, so they can be pruned near the horizon.
+  bool quiet = !is_capture(move) && !update_islands_table;
+
+  // If the move can not reach the bound even with a margin at a frontier node,
+  // it is futile to search it. The margin is returned as an upper bound.
+  if (quiet && frame->max_depth == 1) {
+    eval_t futile_evaluation =
+        turn ? frame->eval_after_move + cache->futility_margin
+             : frame->eval_after_move - cache->futility_margin;
+
+    if (turn ? futile_evaluation < alpha : futile_evaluation > beta) {
+#ifdef MEASURE_EVAL_COUNT
+      measure_count.futility_prune_count++;
+#endif
+      undo_last_move(state, history);
+      *evaluation = futile_evaluation;
+      return true;
+    }
+  }
+
+  // After enough moves are searched near the horizon, the remaining quiet
+  // moves are not searched at all. Pruned moves count as losing to a mate, so
+  // they are searched while every move so far loses to a mate. Otherwise the
+  // node would be remembered as a mate it was never proven to be.
+  bool losing = is_mate(frame->best_evaluation) &&
+                (turn ? frame->best_evaluation < 0 : frame->best_evaluation > 0);
+  if (quiet && !losing &&
+      frame->max_depth <= cache->late_move_pruning_max_depth &&
+      frame->index >= cache->late_move_pruning_count[frame->max_depth]) {
+#ifdef MEASURE_EVAL_COUNT
+    measure_count.late_move_prune_count++;
+#endif
+    undo_last_move(state, history);
+    *evaluation = turn ? EVAL_BLACK_MATES : EVAL_WHITE_MATES;
+    return true;
+  }
+
+  // Since we already know that after move ordering, late moves are probably
+  // bad. Because of that, do a shallower search on them. If they are too
+  // good, do a full search.
+  size_t reduction =
+      get_late_move_reduction(cache, history, frame, move, quiet);
+  if (reduction) {
+#ifdef MEASURE_EVAL_COUNT
+    measure_count.late_move_reduction_counts[reduction < LMR_STATS
+                                                 ? reduction - 1
+                                                 : LMR_STATS - 1]++;
+#endif
+
+    frame->stage = STAGE_MOVE_REDUCED;
+    _push_frame(cache, new_depth - reduction, frame->eval_after_move,
+                frame->search_alpha, frame->search_beta);
+    return false;
+  }
+
+  frame->stage = STAGE_MOVE_SEARCHED;
+  _push_frame(cache, new_depth, frame->eval_after_move, frame->search_alpha,
+              frame->search_beta);
+  return false;
+}
+
+// Continue the search of a frame until it either pushes a child frame or
+// returns.
+// Returns true and sets the evaluation if the frame returned, or false if a
+// child frame was pushed. EVAL_INVALID is returned if the search is stopped.
+static bool _search_step(board_state_t *state, history_t *history,
+                         ai_cache_t *cache, search_frame_t *frame,
+                         eval_t *evaluation) {
+  bool turn = frame->turn;
+  eval_t child_evaluation = frame->child_evaluation;
+
+  switch (frame->stage) {
+  case STAGE_ENTER:
+    break;
+
+  case STAGE_NULL_MOVE:
+    undo_null_move(state, history);
+
+    if (turn ? child_evaluation > frame->beta
+             : child_evaluation < frame->alpha) {
+#ifdef MEASURE_EVAL_COUNT
+      measure_count.null_move_cut_count++;
+#endif
+
+      // Verify the cutoff with a reduced search of the node.
+      frame->stage = STAGE_NULL_MOVE_VERIFY;
+      _push_frame(cache, frame->max_depth - cache->null_move_reduction,
+                  frame->old_evaluation, frame->bound, frame->bound);
+      return false;
+    }
+    goto probcut;
+
+  case STAGE_NULL_MOVE_VERIFY:
+    if (turn ? child_evaluation > frame->beta
+             : child_evaluation < frame->alpha) {
+      *evaluation = child_evaluation;
+      return true;
+    }
+
+#ifdef MEASURE_EVAL_COUNT
+    measure_count.null_move_fail_count++;
+#endif
+    goto probcut;
+
+  case STAGE_PROBCUT:
+    if (turn ? child_evaluation > frame->bound
+             : child_evaluation < frame->bound) {
+#ifdef MEASURE_EVAL_COUNT
+      measure_count.probcut_cut_count++;
+#endif
+      *evaluation = child_evaluation;
+      return true;
+    }
+    goto iid;
+
+  case STAGE_IID:
+    frame->hash_move = frame->child_best_move;
+    goto pick_moves;
+
+  case STAGE_MULTI_CUT:
+    undo_last_move(state, history);
+
+    if (turn ? child_evaluation > frame->beta
+             : child_evaluation < frame->alpha) {
+      if (turn ? child_evaluation > frame->best_evaluation
+               : child_evaluation < frame->best_evaluation)
+        frame->best_evaluation = child_evaluation;
+
+      if (++frame->cut_count >= cache->multi_cut_count) {
+#ifdef MEASURE_EVAL_COUNT
+        measure_count.multi_cut_count++;
+#endif
+        *evaluation = frame->best_evaluation;
+        return true;
+      }
+    }
+
+    frame->index++;
+    goto multi_cut;
+
+  case STAGE_NEXT_MOVE:
+    goto next_move;
+
+  case STAGE_MOVE_REDUCED:
+    // If the shallow search did not fail against the bound of the move, do a
+    // full search.
+    if (turn ? child_evaluation >= frame->search_beta
+             : child_evaluation <= frame->search_alpha) {
+#ifdef MEASURE_EVAL_COUNT
+      measure_count.late_move_research_count++;
+#endif
+
+      frame->stage = STAGE_MOVE_SEARCHED;
+      _push_frame(cache, frame->max_depth - 1, frame->eval_after_move,
+                  frame->search_alpha, frame->search_beta);
+      return false;
+    }
+    goto move_searched;
+
+  case STAGE_MOVE_SEARCHED:
+    // If the move turned out to be better than the current bound but not
+    // good enough to cause a cutoff, search again to get its exact value.
+    if (frame->null_window &&
+        (turn ? child_evaluation > frame->alpha &&
+                    child_evaluation <= frame->beta
+              : child_evaluation < frame->beta &&
+                    child_evaluation >= frame->alpha)) {
+#ifdef MEASURE_EVAL_COUNT
+      measure_count.pvs_research_count++;
+#endif
+
+      frame->stage = STAGE_MOVE_RESEARCHED;
+      _push_frame(cache, frame->max_depth - 1, frame->eval_after_move,
+                  frame->alpha, frame->beta);
+      return false;
+    }
+    goto move_searched;
+
+  case STAGE_MOVE_RESEARCHED:
+    goto move_searched;
+  }
+
+  if (is_search_canceled(cache) || is_split_point_cut(cache->split_point)) {
+    *evaluation = EVAL_INVALID;
+    return true;
   }
 
   // Can be used to debug whilst trying to optimise the evaluate function.
 #ifdef MEASURE_EVAL_COUNT
-  evaluate_count++;
+  measure_count.evaluate_count++;
 #endif
 
+  frame->turn = turn = state->turn;
+
   // Check for the board state.
   // If the game should not continue, return the evaluation.
   // No need to memorize, as it will take equally as long.
   // No need to add to the transposition table though, as it will take equally
   // as long.
-  switch (state->status & 0x30) {
-  case 0x10:
-#ifdef MEASURE_EVAL_COUNT
-    game_end_count++;
-#endif
-    return 0;
-  case 0x20:
-#ifdef MEASURE_EVAL_COUNT
-    game_end_count++;
-#endif
-    return EVAL_WHITE_MATES - history->size;
-  case 0x30:
+  *evaluation = game_end_evaluation(state, history);
+  if (*evaluation != EVAL_INVALID)
+    return true;
+
+  // Check if this board was previously calcuated. Even if the evaluation can
+  // not be used, the best move of the board is searched first.
+  *evaluation = try_find_tt(cache, state->hash, history->size,
+                            frame->max_depth > 1 ? frame->max_depth : 1,
+                            frame->alpha, frame->beta, &frame->hash_move);
+
+  if (*evaluation != EVAL_INVALID) {
 #ifdef MEASURE_EVAL_COUNT
-    game_end_count++;
+    measure_count.tt_remember_count++;
 #endif
-    return EVAL_BLACK_MATES + history->size;
+    return true;
   }
 
-  // Check if this board was previously calcuated.
-  {
-    eval_t possible_eval =
-        try_find_tt(cache, state->hash, history->size,
-                    max_depth > 1 ? max_depth : 1, alpha, beta);
+  // Once a player is down to a single piece, try to solve the position instead
+  // of searching it. This is only done right after the capture, if the solver
+  // can not find a mate, it will not find one in the following positions
+  // either. The solver is limited to a few plies, as a search may reach many
+  // of these positions.
+  if (frame->max_depth && is_lone_capture(state, history)) {
+    *evaluation = lone_solve(state, history, cache->stop_search,
+                             frame->max_depth < cache->lone_solver_max_depth
+                                 ? frame->max_depth
+                                 : cache->lone_solver_max_depth,
+                             NULL);
 
-    if (possible_eval != EVAL_INVALID) {
+    if (*evaluation != EVAL_INVALID) {
 #ifdef MEASURE_EVAL_COUNT
-      tt_remember_count++;
+      measure_count.lone_solved_count++;
 #endif
-      return possible_eval;
+
+      try_add_tt(cache, state->hash, history->size, frame->max_depth,
+                 *evaluation, EXACT, MOVE_INV);
+      return true;
     }
   }
 
-  // Check if we reached the end of the best_line buffer.
-  // If so, just return the evaluation.
+  // Check if we reached the end of the search depth.
+  // If so, continue with the capture moves until the position is quiet.
   // No need to add to transposition table as finding a depth 0 branch is almost
   // useless.
-  if (!max_depth) {
+  if (!frame->max_depth) {
 #ifdef MEASURE_EVAL_COUNT
-    leaf_count++;
+    measure_count.leaf_count++;
 #endif
 
-    return old_evaluation;
+    *evaluation = _quiescence(state, history, cache, frame->old_evaluation,
+                              frame->alpha, frame->beta, 0);
+    return true;
   }
 
-  move_t moves[256];
-  generate_moves(state, moves);
+  generate_moves(state, frame->moves);
 
   // Check for draw by no moves.
-  if (!is_valid_move(moves[0])) {
-    return 0;
+  if (!is_valid_move(frame->moves[0])) {
+    *evaluation = 0;
+    return true;
   }
 
-  // Order moves for better pruning.
-  order_moves(state, cache, moves, state->turn, killer_moves);
+  // If the position is far worse than the bound near the horizon, the node
+  // fails without searching the quiet moves. Captures are forced, so this is
+  // only done when the player has no captures, and the evaluation is the static
+  // evaluation of the node.
+  if (frame->max_depth <= 2 && !is_capture(frame->moves[0]) &&
+      !is_last_move_capture(history)) {
+    eval_t razor_margin = cache->razoring_margin[frame->max_depth - 1];
 
-  eval_t best_evaluation = state->turn ? EVAL_BLACK_MATES : EVAL_WHITE_MATES;
-  move_t new_killer_moves[256] = {MOVE_INV};
+    if (turn ? frame->old_evaluation + razor_margin < frame->alpha
+             : frame->old_evaluation - razor_margin > frame->beta) {
+#ifdef MEASURE_EVAL_COUNT
+      measure_count.razoring_cut_count++;
+#endif
+      *evaluation = frame->old_evaluation;
+      return true;
+    }
+  }
 
-  // Loop through all of the available moves except the first, and recursively
-  // get the next moves.
-  for (int i = 0; is_valid_move(moves[i]); i++) {
-    move_t move = moves[i];
-    size_t new_depth = max_depth - 1;
-    eval_t evaluation;
+  // Try to prove a cutoff by passing the turn to the opponent, and doing a
+  // reduced search. If the player is still better than the bound, the position
+  // is most likely good enough to be cut, without searching any moves.
+  // A reduced search of the node verifies the cutoff, as passing the turn is
+  // not a legal move and the position may be a zugzwang.
+  frame->bound = turn ? frame->beta : frame->alpha;
+  if (can_null_move(state, history, cache, frame->moves, frame->max_depth) &&
+      !is_mate(frame->bound)) {
+    do_null_move(state, history);
+    frame->stage = STAGE_NULL_MOVE;
+    _push_frame(cache, frame->max_depth - 1 - cache->null_move_reduction,
+                frame->old_evaluation, frame->bound, frame->bound);
+    return false;
+  }
 
-    // Since capture moves are important and should be searched better,
-    // we extend the search depth for these moves.
-    if (is_capture(move))
-      new_depth += cache->exchange_deepening;
+probcut:
+  // Search the node with a shallow zero width search on a bound beyond the
+  // current bound. If the shallow search passes that bound, the full search is
+  // expected to pass the current bound as well, so the node can be cut.
+  // Only used on zero width windows, where the node is expected to be cut.
+  if (frame->alpha == frame->beta &&
+      frame->max_depth >= cache->probcut_min_depth && !is_mate(frame->beta)) {
+    size_t depth = frame->max_depth < PROBCUT_DEPTHS ? frame->max_depth
+                                                     : PROBCUT_DEPTHS - 1;
+    eval_t margin = cache->probcut_margin[depth];
+    frame->bound = turn ? frame->beta + margin : frame->alpha - margin;
 
-      // Test if the board state changes after making and unmaking moves.
-#if defined(TEST_EVAL_STATE) && !defined(NDEBUG)
-    board_t _test_old_board = *board;
-    state_cache_t _test_old_state = *state;
+#ifdef MEASURE_EVAL_COUNT
+    measure_count.probcut_try_count++;
+#endif
+
+    frame->stage = STAGE_PROBCUT;
+    _push_frame(cache, frame->max_depth - cache->probcut_reduction,
+                frame->old_evaluation, frame->bound, frame->bound);
+    return false;
+  }
+
+iid:
+  // Nodes with an open window are searched fully, so their first move should
+  // be good. Without a hash move, search the node with a reduced depth first,
+  // and search the best move of that search first.
+  if (frame->alpha != frame->beta && frame->max_depth >= cache->iid_min_depth &&
+      !is_valid_move(frame->hash_move)) {
+#ifdef MEASURE_EVAL_COUNT
+    measure_count.iid_count++;
 #endif
 
+    frame->stage = STAGE_IID;
+    _push_frame(cache, frame->max_depth - cache->iid_reduction,
+                frame->old_evaluation, frame->alpha, frame->beta);
+    return false;
+  }
+
+pick_moves:
+  // Order moves for better pruning. The moves are only ordered as far as they
+  // are searched, as most of the nodes are cut after a few moves.
+  setup_move_picker(&frame->picker, frame->moves, frame->hash_move);
+
+  // Search the first moves of the node with a reduced depth. If enough of them
+  // are better than the bound, the node is most likely going to be cut.
+  if (!cache->multi_cut_count || frame->alpha != frame->beta ||
+      frame->max_depth < cache->multi_cut_min_depth)
+    goto search_moves;
+
+  frame->best_evaluation = turn ? EVAL_BLACK_MATES : EVAL_WHITE_MATES;
+  frame->cut_count = 0;
+  frame->index = 0;
+
+multi_cut:
+  if (frame->index < cache->multi_cut_moves &&
+      pick_move(state, history, cache, &frame->picker, frame->moves,
+                frame->index)) {
+    move_t move = frame->moves[frame->index];
     bool update_islands_table = do_move(state, history, move);
+    int eval_after_move = new_evaluation(
+        state, cache, move, frame->old_evaluation, update_islands_table);
 
-    // Get the new evaluation value after the move.
-    int eval_after_move = new_evaluation(state, cache, move, old_evaluation,
-                                         update_islands_table);
+    frame->stage = STAGE_MULTI_CUT;
+    _push_frame(cache, frame->max_depth - 1 - cache->multi_cut_reduction,
+                eval_after_move, frame->alpha, frame->beta);
+    return false;
+  }
 
-    // Since we already know that after move ordering, late moves are probably
-    // bad. Because of that, do a shallower search on them. If they are too
-    // good, do a full search.
-    bool full_search = true;
-    if (i >= cache->late_move_reduction &&
-        new_depth >= cache->late_move_min_depth) {
-      evaluation = _evaluate(state, history, cache, new_depth - 1,
-                             eval_after_move, alpha, beta, new_killer_moves);
+search_moves:
+  frame->best_evaluation = turn ? EVAL_BLACK_MATES : EVAL_WHITE_MATES;
 
-      // If the shallow search returned a great move, do a full search.
-      full_search = (evaluation < best_evaluation) ^ state->turn;
-    }
+  // Keep the original window, to check if the result is exact.
+  frame->original_alpha = frame->alpha;
+  frame->original_beta = frame->beta;
 
-    if (full_search) {
-      evaluation = _evaluate(state, history, cache, new_depth, eval_after_move,
-                             alpha, beta, new_killer_moves);
-    }
+  // Loop through all of the available moves, and search the next moves.
+  frame->index = 0;
 
-    undo_last_move(state, history);
+next_move:
+  if (!pick_move(state, history, cache, &frame->picker, frame->moves,
+                 frame->index))
+    goto end_of_moves;
 
-    if (evaluation == EVAL_INVALID) {
-      return EVAL_INVALID;
+  // After the first move is searched, the remaining moves may be searched by
+  // the idle threads as well.
+  if (frame->index > 0 && cache->split_pool &&
+      frame->max_depth >= cache->split_min_depth &&
+      __atomic_load_n(&cache->split_pool->idle_count, __ATOMIC_RELAXED)) {
+    // The other threads take the moves in order, so order all of them.
+    pick_all_moves(state, history, cache, &frame->picker, frame->moves);
+
+    bool cut = false;
+    frame->best_evaluation =
+        _split(state, history, cache, frame->moves, frame->index,
+               frame->max_depth, frame->old_evaluation, frame->alpha,
+               frame->beta, frame->best_evaluation, &frame->best_move, &cut);
+
+    if (frame->best_evaluation == EVAL_INVALID) {
+      *evaluation = EVAL_INVALID;
+      return true;
     }
 
-#ifdef TEST_EVAL_STATE
-    assert(_test_old_state.hash == state->hash &&
-           compare(board, (board_t *)&_test_old_board));
-    assert(_test_old_state.white_count == state->white_count);
-    assert(_test_old_state.white_island_count == state->white_island_count);
-    assert(_test_old_state.black_count == state->black_count);
-    assert(_test_old_state.black_island_count == state->black_island_count);
-    assert(_test_old_state.status == state->status);
+    if (cut) {
+#ifdef MEASURE_EVAL_COUNT
+      measure_count.ab_branch_cut_count++;
 #endif
 
-    // If this move is not better than the found moves, continue.
-    if (state->turn ? evaluation <= best_evaluation
-                    : evaluation >= best_evaluation) {
-      continue;
+      // Remember the move that cut the node, as after a serial cut.
+      try_add_tt(cache, state->hash, history->size, frame->max_depth,
+                 frame->best_evaluation, turn ? LOWER : UPPER,
+                 frame->best_move);
+
+      *evaluation = frame->best_evaluation;
+      return true;
     }
 
-    best_evaluation = evaluation;
+    goto end_of_moves;
+  }
+
+  // Test if the board state changes after making and unmaking moves.
+#if defined(TEST_EVAL_STATE) && !defined(NDEBUG)
+  frame->test_old_state = *state;
+#endif
+
+  if (!_search_move_begin(state, history, cache, frame, &child_evaluation))
+    return false;
+  goto move_done;
+
+move_searched:
+  undo_last_move(state, history);
+
+move_done:
+#if defined(TEST_EVAL_STATE) && !defined(NDEBUG)
+  assert(frame->test_old_state.hash == state->hash &&
+         !memcmp(frame->test_old_state.board, state->board,
+                 sizeof(state->board)));
+  assert(frame->test_old_state.white_count == state->white_count);
+  assert(frame->test_old_state.white_island_count ==
+         state->white_island_count);
+  assert(frame->test_old_state.black_count == state->black_count);
+  assert(frame->test_old_state.black_island_count ==
+         state->black_island_count);
+  assert(frame->test_old_state.status == state->status);
+#endif
+
+  if (frame->single_move) {
+    *evaluation = child_evaluation;
+    return true;
+  }
+
+  // If this move is better than the found moves, update the bounds.
+  if (turn ? child_evaluation > frame->best_evaluation
+           : child_evaluation < frame->best_evaluation) {
+    frame->best_evaluation = child_evaluation;
+    frame->best_move = frame->moves[frame->index];
 
     // Update the limit variables alpha and beta.
-    if (state->turn) {
-      if (evaluation > beta) {
+    if (turn ? child_evaluation > frame->beta
+             : child_evaluation < frame->alpha) {
 #ifdef MEASURE_EVAL_COUNT
-        ab_branch_cut_count++;
+      measure_count.ab_branch_cut_count++;
+      if (!frame->index)
+        measure_count.first_move_cut_count++;
 #endif
 
-        // Add this move to killer moves.
-        int i = 0;
-        while (is_valid_move(killer_moves[i]))
-          i++;
-        killer_moves[i] = move;
-        killer_moves[i + 1] = MOVE_INV;
+      // Remember the move for ordering the moves of the other nodes.
+      add_cut_move(cache, history, turn, frame->moves[frame->index],
+                   frame->max_depth);
 
-        // try_add_tt(cache, state->hash, history->size, max_depth,
-        // best_evaluation, LOWER);
-        return best_evaluation;
+      // Remember the move that cut the node, to search it first the next time
+      // the node is searched. The evaluation is only a bound.
+      try_add_tt(cache, state->hash, history->size, frame->max_depth,
+                 frame->best_evaluation, turn ? LOWER : UPPER,
+                 frame->best_move);
+
+      *evaluation = frame->best_evaluation;
+      return true;
+    }
+
+    if (turn ? child_evaluation > frame->alpha
+             : child_evaluation < frame->beta) {
+      if (turn)
+        frame->alpha = child_evaluation;
+      else
+        frame->beta = child_evaluation;
+    }
+  }
+
+  frame->index++;
+  goto next_move;
+
+end_of_moves:
+  *evaluation = frame->best_evaluation;
+
+  // If all of the moves failed low, the evaluation is only a bound, and none
+  // of the moves is known to be the best.
+  if (turn ? frame->best_evaluation < frame->original_alpha
+           : frame->best_evaluation > frame->original_beta) {
+    try_add_tt(cache, state->hash, history->size, frame->max_depth,
+               frame->best_evaluation, turn ? UPPER : LOWER, MOVE_INV);
+    return true;
+  }
+
+  try_add_tt(cache, state->hash, history->size, frame->max_depth,
+             frame->best_evaluation, EXACT, frame->best_move);
+
+  return true;
+}
+
+// Step the frames on the search stack above base, until the frame at base
+// returns.
+// If the search is stopped, the moves made by the frames are undone and the
+// frames are dropped at once, without stepping them again.
+static eval_t _run_search(board_state_t *state, history_t *history,
+                          ai_cache_t *cache, size_t base,
+                          size_t history_base) {
+  while (true) {
+    search_frame_t *frame = &cache->search_stack[cache->search_stack_size - 1];
+
+    eval_t evaluation;
+    if (!_search_step(state, history, cache, frame, &evaluation))
+      continue;
+
+    cache->search_stack_size--;
+
+    if (evaluation == EVAL_INVALID) {
+      while (history->size > history_base) {
+        if (is_valid_move(history->history[history->size - 1].move))
+          undo_last_move(state, history);
+        else
+          undo_null_move(state, history);
       }
 
-      if (evaluation > alpha)
-        alpha = evaluation;
+      cache->search_stack_size = base;
+      return EVAL_INVALID;
+    }
 
-    } else {
-      if (evaluation < alpha) {
-#ifdef MEASURE_EVAL_COUNT
-        ab_branch_cut_count++;
+    if (cache->search_stack_size == base)
+      return evaluation;
+
+    search_frame_t *parent = &cache->search_stack[cache->search_stack_size - 1];
+    parent->child_evaluation = evaluation;
+    parent->child_best_move = frame->best_move;
+  }
+}
+
+// Search a child move of a node, using late move reduction and principal
+// variation search.
+static eval_t _search_move(board_state_t *state, history_t *history,
+                           ai_cache_t *cache, move_t move, int index,
+                           size_t max_depth, int old_evaluation, eval_t alpha,
+                           eval_t beta, eval_t best_evaluation) {
+  size_t base = cache->search_stack_size;
+  size_t history_base = history->size;
+
+  search_frame_t *frame =
+      _push_frame(cache, max_depth, old_evaluation, alpha, beta);
+  frame->single_move = true;
+  frame->turn = state->turn;
+  frame->moves[index] = move;
+  frame->index = index;
+  frame->best_evaluation = best_evaluation;
+
+#if defined(TEST_EVAL_STATE) && !defined(NDEBUG)
+  frame->test_old_state = *state;
 #endif
 
-        // Add this move to killer moves.
-        int i = 0;
-        while (is_valid_move(killer_moves[i]))
-          i++;
-        killer_moves[i] = move;
-        killer_moves[i + 1] = MOVE_INV;
+  eval_t evaluation;
+  if (_search_move_begin(state, history, cache, frame, &evaluation)) {
+    cache->search_stack_size--;
+  } else {
+    evaluation = _run_search(state, history, cache, base, history_base);
+  }
 
-        // try_add_tt(cache, state->hash, history->size, max_depth,
-        // best_evaluation, UPPER);
-        return best_evaluation;
+  return evaluation;
+}
+
+// Take moves from a split point and search them, until there are no moves
+// left or the split point is cut.
+static void _search_split_point(board_state_t *state, history_t *history,
+                                ai_cache_t *cache, split_point_t *split_point) {
+  while (true) {
+    pthread_mutex_lock(&split_point->lock);
+
+    if (split_point->cut || split_point->aborted ||
+        !is_valid_move(split_point->moves[split_point->next_move])) {
+      pthread_mutex_unlock(&split_point->lock);
+      return;
+    }
+
+    size_t i = split_point->next_move++;
+    move_t move = split_point->moves[i];
+    eval_t alpha = split_point->alpha;
+    eval_t beta = split_point->beta;
+    eval_t best_evaluation = split_point->best_evaluation;
+
+    pthread_mutex_unlock(&split_point->lock);
+
+    eval_t evaluation =
+        _search_move(state, history, cache, move, i, split_point->max_depth,
+                     split_point->old_evaluation, alpha, beta, best_evaluation);
+
+    pthread_mutex_lock(&split_point->lock);
+
+    // The search was stopped either because this split point was cut by
+    // another thread, or because a parent was cut or the search was canceled.
+    if (evaluation == EVAL_INVALID) {
+      if (!split_point->cut)
+        split_point->aborted = true;
+      pthread_mutex_unlock(&split_point->lock);
+      return;
+    }
+
+    // Bounds may have changed while searching, compare against the current
+    // values.
+    if (!split_point->cut && (state->turn
+                                  ? evaluation > split_point->best_evaluation
+                                  : evaluation < split_point->best_evaluation)) {
+      split_point->best_evaluation = evaluation;
+      split_point->best_move = move;
+
+      if (state->turn) {
+        if (evaluation > split_point->beta) {
+          __atomic_store_n(&split_point->cut, true, __ATOMIC_RELAXED);
+          add_cut_move(cache, history, state->turn, move,
+                       split_point->max_depth);
+        } else if (evaluation > split_point->alpha) {
+          split_point->alpha = evaluation;
+        }
+      } else {
+        if (evaluation < split_point->alpha) {
+          __atomic_store_n(&split_point->cut, true, __ATOMIC_RELAXED);
+          add_cut_move(cache, history, state->turn, move,
+                       split_point->max_depth);
+        } else if (evaluation < split_point->beta) {
+          split_point->beta = evaluation;
+        }
       }
+    }
 
-      if (evaluation < beta)
-        beta = evaluation;
+    pthread_mutex_unlock(&split_point->lock);
+  }
+}
+
+// Wait for split points and help searching them, until the search is stopped.
+void _split_worker_routine(board_state_t *state, history_t *history,
+                           ai_cache_t *cache) {
+  split_pool_t *pool = cache->split_pool;
+
+  pthread_mutex_lock(&pool->lock);
+
+  while (true) {
+    split_point_t *split_point = pool->open;
+
+    if (pool->stop) {
+      pthread_mutex_unlock(&pool->lock);
+      return;
     }
+
+    if (!split_point) {
+      __atomic_add_fetch(&pool->idle_count, 1, __ATOMIC_RELAXED);
+      pthread_cond_wait(&pool->available, &pool->lock);
+      __atomic_sub_fetch(&pool->idle_count, 1, __ATOMIC_RELAXED);
+      continue;
+    }
+
+    // Join the split point. The owner can not leave it before this thread
+    // leaves, so it is safe to use it after unlocking the pool.
+    pthread_mutex_lock(&split_point->lock);
+    split_point->workers++;
+    pthread_mutex_unlock(&split_point->lock);
+
+    pthread_mutex_unlock(&pool->lock);
+
+    // Copy the position of the split point.
+    *state = split_point->state;
+    history->size = split_point->history_size;
+    memcpy(history->history, split_point->history->history,
+           sizeof(history_item_t) * split_point->history_size);
+
+    cache->split_point = split_point;
+    _search_split_point(state, history, cache, split_point);
+    cache->split_point = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+
+    // Take the split point off the list, so that the other idle threads do not
+    // try to join it.
+    split_point_t **open = &pool->open;
+    while (*open && *open != split_point)
+      open = &(*open)->next;
+    if (*open)
+      *open = split_point->next;
+
+    pthread_mutex_lock(&split_point->lock);
+    if (!--split_point->workers)
+      pthread_cond_signal(&split_point->done);
+    pthread_mutex_unlock(&split_point->lock);
   }
+}
 
-  try_add_tt(cache, state->hash, history->size, max_depth, best_evaluation,
-             EXACT);
+// Search the remaining moves of a node together with the idle threads.
+// best_move is replaced by the move of the returned evaluation.
+static eval_t _split(board_state_t *state, history_t *history,
+                     ai_cache_t *cache, move_t *moves, size_t next_move,
+                     size_t max_depth, int old_evaluation, eval_t alpha,
+                     eval_t beta, eval_t best_evaluation, move_t *best_move,
+                     bool *cut) {
+  split_pool_t *pool = cache->split_pool;
 
-  return best_evaluation;
+#ifdef MEASURE_EVAL_COUNT
+  measure_count.split_count++;
+#endif
+
+  split_point_t split_point = {
+      .parent = cache->split_point,
+      .state = *state,
+      .history = history,
+      .history_size = history->size,
+      .max_depth = max_depth,
+      .old_evaluation = old_evaluation,
+      .moves = moves,
+      .next_move = next_move,
+      .alpha = alpha,
+      .beta = beta,
+      .best_evaluation = best_evaluation,
+      .best_move = *best_move,
+      .workers = 1,
+      .cut = false,
+      .aborted = false,
+  };
+  pthread_mutex_init(&split_point.lock, NULL);
+  pthread_cond_init(&split_point.done, NULL);
+
+  // Open the split point for the idle threads.
+  pthread_mutex_lock(&pool->lock);
+  split_point.next = pool->open;
+  pool->open = &split_point;
+  pthread_cond_broadcast(&pool->available);
+  pthread_mutex_unlock(&pool->lock);
+
+  cache->split_point = &split_point;
+  _search_split_point(state, history, cache, &split_point);
+  cache->split_point = split_point.parent;
+
+  // Close the split point, if no other thread did.
+  pthread_mutex_lock(&pool->lock);
+  split_point_t **open = &pool->open;
+  while (*open && *open != &split_point)
+    open = &(*open)->next;
+  if (*open)
+    *open = split_point.next;
+  pthread_mutex_unlock(&pool->lock);
+
+  // Wait for the other threads to finish their moves.
+  pthread_mutex_lock(&split_point.lock);
+  split_point.workers--;
+  while (split_point.workers)
+    pthread_cond_wait(&split_point.done, &split_point.lock);
+  pthread_mutex_unlock(&split_point.lock);
+
+  pthread_mutex_destroy(&split_point.lock);
+  pthread_cond_destroy(&split_point.done);
+
+  if (split_point.aborted || cache->cancel_search)
+    return EVAL_INVALID;
+
+  *cut = split_point.cut;
+  *best_move = split_point.best_move;
+  return split_point.best_evaluation;
+}
+
+// Find the best continuing moves available and their evaluation value.
+// The search runs on the search stack of the thread instead of recursing, so
+// the nodes that are being searched can be dropped at once if the search is
+// stopped.
+eval_t _evaluate(board_state_t *state, history_t *history, ai_cache_t *cache,
+                 size_t max_depth, int old_evaluation, eval_t alpha,
+                 eval_t beta) {
+  size_t base = cache->search_stack_size;
+  size_t history_base = history->size;
+
+  _push_frame(cache, max_depth, old_evaluation, alpha, beta);
+  return _run_search(state, history, cache, base, history_base);
 }
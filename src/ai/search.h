@@ -27,6 +27,11 @@ JazzInSea. If not, see <https://www.gnu.org/licenses/>.
 #include "state/history.h"
 
 eval_t _evaluate(board_state_t *, history_t *, ai_cache_t *, size_t, int,
-                 eval_t, eval_t, move_t *);
+                 eval_t, eval_t);
+
+void _split_worker_routine(board_state_t *, history_t *, ai_cache_t *);
+
+void setup_search_stack(ai_cache_t *, size_t);
+void free_search_stack(ai_cache_t *);
 
 #endif
@@ -0,0 +1,118 @@
+/*
+This file is part of JazzInSea.
+
+JazzInSea is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+JazzInSea is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+JazzInSea. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _AI_SEARCH_STACK_H
+#define _AI_SEARCH_STACK_H
+
+#include "ai/eval_t.h"
+#include "ai/move_picker_t.h"
+#include "move/move_t.h"
+#include "state/board_state_t.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// The point where a search frame continues from, when it is stepped.
+typedef enum {
+  // The frame was just pushed.
+  STAGE_ENTER,
+
+  // Waiting for the search after passing the turn.
+  STAGE_NULL_MOVE,
+
+  // Waiting for the reduced search that verifies a null move cutoff.
+  STAGE_NULL_MOVE_VERIFY,
+
+  // Waiting for the shallow ProbCut search.
+  STAGE_PROBCUT,
+
+  // Waiting for the reduced search of the node that finds the hash move.
+  STAGE_IID,
+
+  // Waiting for the reduced search of one of the multi-cut moves.
+  STAGE_MULTI_CUT,
+
+  // Ready to search the next move.
+  STAGE_NEXT_MOVE,
+
+  // Waiting for the late move reduction search of the current move.
+  STAGE_MOVE_REDUCED,
+
+  // Waiting for the full search of the current move.
+  STAGE_MOVE_SEARCHED,
+
+  // Waiting for the re-search of the current move with the full window.
+  STAGE_MOVE_RESEARCHED,
+} search_stage_t;
+
+// A node of the search, with all of the variables that have to live while its
+// children are searched.
+typedef struct {
+  search_stage_t stage;
+
+  // If set, the frame only searches the move at moves[index], and returns its
+  // evaluation instead of the evaluation of the node.
+  bool single_move;
+
+  // Arguments of the node.
+  size_t max_depth;
+  int old_evaluation;
+  eval_t alpha;
+  eval_t beta;
+
+  // The color to move on the node. The state may belong to a child while the
+  // frame waits.
+  bool turn;
+
+  move_t moves[256];
+  move_picker_t picker;
+
+  // The move searched first, from the transposition table or the internal
+  // iterative deepening search. MOVE_INV if there is none.
+  move_t hash_move;
+
+  // The move of the best evaluation, MOVE_INV if no move was searched, or the
+  // moves were searched together with the other threads.
+  move_t best_move;
+
+  eval_t best_evaluation;
+  eval_t original_alpha;
+  eval_t original_beta;
+
+  // The bound of the null move and the ProbCut searches.
+  eval_t bound;
+
+  // Number of moves that passed the bound in the multi-cut search.
+  size_t cut_count;
+
+  // The move that is being searched.
+  size_t index;
+  bool null_window;
+  eval_t search_alpha;
+  eval_t search_beta;
+  int eval_after_move;
+
+  // The evaluation and the best move returned by the last searched child
+  // frame.
+  eval_t child_evaluation;
+  move_t child_best_move;
+
+#if defined(TEST_EVAL_STATE) && !defined(NDEBUG)
+  board_state_t test_old_state;
+#endif
+} search_frame_t;
+
+#endif
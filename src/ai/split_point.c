@@ -0,0 +1,42 @@
+/*
+This file is part of JazzInSea.
+
+JazzInSea is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+JazzInSea is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+JazzInSea. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "ai/split_point.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+void setup_split_pool(split_pool_t *pool) {
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->available, NULL);
+  pool->open = NULL;
+  pool->idle_count = 0;
+  pool->stop = false;
+}
+
+// Wake up all of the waiting threads and make them return.
+void stop_split_pool(split_pool_t *pool) {
+  pthread_mutex_lock(&pool->lock);
+  pool->stop = true;
+  pthread_cond_broadcast(&pool->available);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+void free_split_pool(split_pool_t *pool) {
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->available);
+}
@@ -0,0 +1,117 @@
+/*
+This file is part of JazzInSea.
+
+JazzInSea is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+JazzInSea is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+JazzInSea. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _AI_SPLIT_POINT_H
+#define _AI_SPLIT_POINT_H
+
+#include "ai/eval_t.h"
+#include "move/move_t.h"
+#include "state/board_state_t.h"
+#include "state/history.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum {
+  // Every thread runs its own iterative deepening search, sharing only the
+  // transposition table.
+  PARALLEL_LAZY,
+
+  // Only the main thread runs iterative deepening, the other threads wait for
+  // split points and search the sibling moves of them.
+  PARALLEL_SPLIT,
+
+  // Every thread runs Monte Carlo tree search on a shared tree, instead of
+  // iterative deepening.
+  PARALLEL_MCTS,
+} parallel_mode_t;
+
+// A node whose first move was searched serially, and whose remaining moves
+// are shared between the threads.
+typedef struct split_point_t {
+  pthread_mutex_t lock;
+
+  // Signaled when the last worker leaves the split point.
+  pthread_cond_t done;
+
+  // The split point the owner thread was working on while creating this one.
+  struct split_point_t *parent;
+
+  // The next split point in the list of open split points.
+  struct split_point_t *next;
+
+  // The node position. The history is the history of the owner thread, only
+  // the first history_size items are used.
+  board_state_t state;
+  history_t *history;
+  size_t history_size;
+
+  size_t max_depth;
+  int old_evaluation;
+
+  // The moves of the node, owned by the owner thread.
+  move_t *moves;
+  size_t next_move;
+
+  eval_t alpha;
+  eval_t beta;
+  eval_t best_evaluation;
+
+  // The move of best_evaluation.
+  move_t best_move;
+
+  // Number of threads working on the split point, including the owner.
+  size_t workers;
+
+  // Set if one of the moves caused a cutoff.
+  bool cut;
+
+  // Set if one of the moves could not be searched completely, because the
+  // search was canceled.
+  bool aborted;
+} split_point_t;
+
+typedef struct {
+  pthread_mutex_t lock;
+
+  // Signaled when a split point is opened or the search is stopped.
+  pthread_cond_t available;
+
+  // List of split points that have moves left to be searched.
+  split_point_t *open;
+
+  // Number of threads waiting for a split point.
+  size_t idle_count;
+
+  bool stop;
+} split_pool_t;
+
+void setup_split_pool(split_pool_t *);
+void stop_split_pool(split_pool_t *);
+void free_split_pool(split_pool_t *);
+
+// Check if the split point or any of its parents were cut.
+static inline bool is_split_point_cut(split_point_t *split_point) {
+  for (; split_point; split_point = split_point->parent) {
+    if (__atomic_load_n(&split_point->cut, __ATOMIC_RELAXED))
+      return true;
+  }
+
+  return false;
+}
+
+#endif
@@ -0,0 +1,81 @@
+/*
+This file is part of JazzInSea.
+
+JazzInSea is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+JazzInSea is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+JazzInSea. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "ai/time_manager.h"
+#include "move/move_t.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+// Number of moves a clock is expected to last for, if the increment was zero.
+#define CLOCK_MOVES_LEFT 30
+
+// Use the whole time for every search.
+time_limits_t fixed_time_limits(struct timespec time) {
+  return (time_limits_t){.soft = time, .hard = time};
+}
+
+// Split the time left on a clock between the moves left in the game. The hard
+// limit allows a search to take a few times its share when it needs to, but
+// never more than a quarter of the time left.
+time_limits_t clock_time_limits(size_t time_left_ms, size_t increment_ms) {
+  size_t soft_ms = time_left_ms / CLOCK_MOVES_LEFT + increment_ms * 3 / 4;
+  size_t hard_ms = soft_ms * 4;
+
+  if (hard_ms > time_left_ms / 4)
+    hard_ms = time_left_ms / 4;
+  if (soft_ms > hard_ms)
+    soft_ms = hard_ms;
+
+  return (time_limits_t){.soft = ms_to_timespec(soft_ms),
+                         .hard = ms_to_timespec(hard_ms)};
+}
+
+void start_time_manager(time_manager_t *manager, time_limits_t limits) {
+  start_unmanaged_time_manager(manager);
+  manager->soft_ms = timespec_to_ms(limits.soft);
+  manager->hard_ms = timespec_to_ms(limits.hard);
+  manager->active = true;
+}
+
+// Start timing the depths of a search without limits. The search keeps going
+// until it is canceled, or until manage_time_manager gives it limits.
+void start_unmanaged_time_manager(time_manager_t *manager) {
+  manager->active = false;
+  clock_gettime(CLOCK_MONOTONIC, &manager->start);
+  manager->offset_ms = 0;
+  manager->last_iteration_ms = 0;
+  manager->previous_iteration_ms = 0;
+  manager->best_move = MOVE_INV;
+  manager->stable_iterations = 0;
+}
+
+// Give limits counting from now to a search that is running on another
+// thread. The search applies them at the end of its next depth.
+void manage_time_manager(time_manager_t *manager, time_limits_t limits) {
+  manager->offset_ms = get_elapsed_ms(manager);
+  manager->soft_ms = timespec_to_ms(limits.soft);
+  manager->hard_ms = timespec_to_ms(limits.hard);
+  __atomic_store_n(&manager->active, true, __ATOMIC_RELEASE);
+}
+
+size_t get_elapsed_ms(time_manager_t *manager) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - manager->start.tv_sec) * 1000 +
+         (now.tv_nsec - manager->start.tv_nsec) / 1000000;
+}
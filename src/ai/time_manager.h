@@ -0,0 +1,76 @@
+/*
+This file is part of JazzInSea.
+
+JazzInSea is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+JazzInSea is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+JazzInSea. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _AI_TIME_MANAGER_H
+#define _AI_TIME_MANAGER_H
+
+#include "move/move_t.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+typedef struct {
+  // No new depth is started if it is predicted to end after the soft limit.
+  struct timespec soft;
+
+  // The search is canceled at the hard limit, even in the middle of a depth.
+  struct timespec hard;
+} time_limits_t;
+
+// Time management of the main search thread.
+typedef struct {
+  // Searches that are not managed only stop at the end of their depth, or if
+  // they are canceled. Set atomically, as a running search may become managed.
+  bool active;
+
+  // The limits count from offset_ms after the start.
+  struct timespec start;
+  size_t offset_ms;
+  size_t soft_ms;
+  size_t hard_ms;
+
+  // Duration of the last two completed depths.
+  size_t last_iteration_ms;
+  size_t previous_iteration_ms;
+
+  // Number of completed depths in a row that selected the same best move.
+  move_t best_move;
+  size_t stable_iterations;
+} time_manager_t;
+
+time_limits_t fixed_time_limits(struct timespec);
+time_limits_t clock_time_limits(size_t, size_t);
+
+void start_time_manager(time_manager_t *, time_limits_t);
+void start_unmanaged_time_manager(time_manager_t *);
+void manage_time_manager(time_manager_t *, time_limits_t);
+size_t get_elapsed_ms(time_manager_t *);
+
+static inline bool is_time_managed(time_manager_t *manager) {
+  return __atomic_load_n(&manager->active, __ATOMIC_ACQUIRE);
+}
+
+static inline size_t timespec_to_ms(struct timespec time) {
+  return time.tv_sec * 1000 + time.tv_nsec / 1000000;
+}
+
+static inline struct timespec ms_to_timespec(size_t milliseconds) {
+  return (struct timespec){.tv_sec = milliseconds / 1000,
+                           .tv_nsec = (milliseconds % 1000) * 1000000};
+}
+
+#endif
@@ -20,70 +20,304 @@ JazzInSea. If not, see <https://www.gnu.org/licenses/>.
 #include "ai/measure_count.h"
 #include "io/pp.h"
 
-// Return the transposition entry for a board hash.
-tt_entry_t *get_entry_tt(ai_cache_t *cache, hash_t hash) {
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
 
-  return &cache->transposition_table[hash % cache->tt_size];
+// Tables are mapped in multiples of the huge page size.
+#define TT_HUGE_PAGE_SIZE ((size_t)2 << 20)
+
+// Most threads used to clear the table.
+#define TT_CLEAR_THREADS_MAX 64
+
+typedef struct {
+  pthread_t thread;
+  void *start;
+  size_t size;
+} clear_job_t;
+
+static void *_clear_routine(void *r_job) {
+  clear_job_t *job = (clear_job_t *)r_job;
+  memset(job->start, 0, job->size);
+  return NULL;
+}
+
+// Clear all of the entries, splitting the table between thread_count threads.
+// Clearing a new table also maps its pages, so that the first search does not
+// wait for them.
+void clear_transposition_table(ai_cache_t *cache, size_t thread_count) {
+  if (!thread_count)
+    thread_count = 1;
+  if (thread_count > TT_CLEAR_THREADS_MAX)
+    thread_count = TT_CLEAR_THREADS_MAX;
+
+  clear_job_t jobs[TT_CLEAR_THREADS_MAX];
+  size_t buckets_per_job = cache->tt_bucket_count / thread_count;
+
+  for (size_t i = 0; i < thread_count; i++) {
+    size_t first = i * buckets_per_job;
+    size_t last =
+        i + 1 == thread_count ? cache->tt_bucket_count : first + buckets_per_job;
+
+    jobs[i] = (clear_job_t){
+        .start = &cache->transposition_table[first],
+        .size = sizeof(tt_bucket_t) * (last - first),
+    };
+  }
+
+  // The calling thread clears the first part. If a thread can not be
+  // created, its part is cleared by the calling thread as well.
+  bool started[TT_CLEAR_THREADS_MAX] = {false};
+  for (size_t i = 1; i < thread_count; i++)
+    started[i] =
+        !pthread_create(&jobs[i].thread, NULL, _clear_routine, &jobs[i]);
+
+  for (size_t i = 0; i < thread_count; i++) {
+    if (!started[i])
+      _clear_routine(&jobs[i]);
+  }
+
+  for (size_t i = 1; i < thread_count; i++) {
+    if (started[i])
+      pthread_join(jobs[i].thread, NULL);
+  }
+}
+
+// Replace the transposition table with a table of the given size in megabytes.
+// The table is backed by huge pages if there are any reserved, otherwise by
+// transparent huge pages, falling back to normal pages.
+// Returns false and keeps the old table if the table can not be allocated.
+bool setup_transposition_table(ai_cache_t *cache, size_t megabytes) {
+#ifdef MEASURE_EVAL_TIME
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+#endif
+
+  size_t size = megabytes << 20;
+  size_t mapped_size =
+      (size + TT_HUGE_PAGE_SIZE - 1) / TT_HUGE_PAGE_SIZE * TT_HUGE_PAGE_SIZE;
+
+  const char *pages = "huge";
+  void *table = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+  if (table == MAP_FAILED) {
+    table = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (table == MAP_FAILED)
+      return false;
+
+    pages = madvise(table, mapped_size, MADV_HUGEPAGE) ? "normal"
+                                                       : "transparent huge";
+  }
+
+  free_transposition_table(cache);
+
+  cache->transposition_table = table;
+  cache->tt_mapped_size = mapped_size;
+  cache->tt_bucket_count = size / sizeof(tt_bucket_t);
+
+#ifdef MEASURE_EVAL_TIME
+  struct timespec mapped;
+  clock_gettime(CLOCK_MONOTONIC, &mapped);
+#endif
+
+  long thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+  clear_transposition_table(cache, thread_count > 0 ? thread_count : 1);
+
+#ifdef MEASURE_EVAL_TIME
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  io_debug();
+  pp_f("measure: mapped the %zu MB transposition table with %s pages in "
+       "%zuus, cleared it with %ld threads in %zuus.\n",
+       megabytes, pages,
+       (size_t)((mapped.tv_sec - start.tv_sec) * 1000000 +
+                (mapped.tv_nsec - start.tv_nsec) / 1000),
+       thread_count > 0 ? thread_count : 1,
+       (size_t)((end.tv_sec - mapped.tv_sec) * 1000000 +
+                (end.tv_nsec - mapped.tv_nsec) / 1000));
+#else
+  (void)pages;
+#endif
+
+  return true;
+}
+
+void free_transposition_table(ai_cache_t *cache) {
+  if (cache->transposition_table)
+    munmap(cache->transposition_table, cache->tt_mapped_size);
+
+  cache->transposition_table = NULL;
+  cache->tt_mapped_size = 0;
+  cache->tt_bucket_count = 0;
+}
+
+// Entries are shared by all of the search threads and are read and written
+// without any locks. Instead of storing the key directly, store it xored with
+// the rest of the entry. If another thread overwrites an entry while it is
+// being read, the xor will not match and the entry will be ignored.
+static inline uint32_t entry_checksum(tt_entry_t *entry) {
+  uint32_t move;
+  memcpy(&move, &entry->move, sizeof(move));
+
+  return (uint32_t)entry->eval ^ move ^ entry->depth ^
+         (uint32_t)entry->node_type << 8 ^ (uint32_t)entry->generation << 16;
+}
+
+// Return the bucket of a board hash. The high bits of the hash select the
+// bucket with a multiplication instead of a division, and the low bits are
+// kept as the key.
+static inline tt_bucket_t *get_bucket_tt(ai_cache_t *cache, hash_t hash) {
+  return &cache->transposition_table[(unsigned __int128)hash *
+                                     cache->tt_bucket_count >> 64];
+}
+
+// Check if the entry holds the board of the hash.
+static inline bool is_entry_of(tt_entry_t *entry, hash_t hash) {
+  return entry->depth && (entry->key ^ entry_checksum(entry)) == (uint32_t)hash;
+}
+
+// Copy the entry of a board hash to entry. Returns false if the board is not
+// saved.
+// The entry is copied through a volatile pointer, so that the checksum is
+// validated against the exact copy that is used afterwards.
+bool find_entry_tt(ai_cache_t *cache, hash_t hash, tt_entry_t *entry) {
+  tt_bucket_t *bucket = get_bucket_tt(cache, hash);
+
+  for (size_t i = 0; i < TT_BUCKET_ENTRIES; i++) {
+    *entry = *(volatile tt_entry_t *)&bucket->entries[i];
+    if (is_entry_of(entry, hash))
+      return true;
+  }
+
+  return false;
 }
 
 // Add the board to the transposition table.
+// The move is the best move of the node, or the move that cut it. If there is
+// no move, the move of an older entry of the same board is kept.
+// Entries of the same board from the current search are only replaced by
+// deeper entries, or by an exact entry of the same depth. Otherwise the board
+// replaces the empty or the least valuable entry of its bucket.
 void try_add_tt(ai_cache_t *cache, hash_t hash, size_t history_size,
-                size_t depth, eval_t eval, node_type_t node_type) {
+                size_t depth, eval_t eval, node_type_t node_type,
+                move_t move) {
 
   // If the eval is an absolute evaluation, convert the depth relative.
   if (is_mate(eval)) {
     eval += eval > 0 ? history_size : -history_size;
-    depth = LONG_MAX;
+    depth = TT_DEPTH_MATE;
+  } else if (depth > TT_DEPTH_MAX) {
+    depth = TT_DEPTH_MAX;
   }
 
-  tt_entry_t *entry = get_entry_tt(cache, hash);
+  tt_bucket_t *bucket = get_bucket_tt(cache, hash);
+  tt_entry_t *entry = NULL;
+  bool same_board = false;
+  int least_value = INT_MAX;
+
+  for (size_t i = 0; i < TT_BUCKET_ENTRIES; i++) {
+    tt_entry_t *candidate = &bucket->entries[i];
+
+    if (is_entry_of(candidate, hash)) {
+      entry = candidate;
+      same_board = true;
+      break;
+    }
+
+    uint8_t age = cache->tt_generation - candidate->generation;
+    int value = candidate->depth ? candidate->depth - age * cache->tt_age_depth
+                                 : INT_MIN;
+    if (value < least_value) {
+      entry = candidate;
+      least_value = value;
+    }
+  }
 
-  if (depth <= entry->depth)
+  if (same_board && entry->generation == cache->tt_generation &&
+      (depth < entry->depth ||
+       (depth == entry->depth &&
+        (node_type != EXACT || entry->node_type == EXACT))))
     return;
 
 #ifdef MEASURE_EVAL_COUNT
   if (!entry->depth)
-    tt_saved_count++;
-  else if (hash == entry->hash)
-    tt_overwritten_count++;
+    measure_count.tt_saved_count++;
+  else if (same_board)
+    measure_count.tt_overwritten_count++;
   else
-    tt_rewritten_count++;
+    measure_count.tt_rewritten_count++;
 #endif
 
-  *entry = (tt_entry_t){
-      .hash = hash,
-      .depth = depth,
+  if (!is_valid_move(move) && same_board)
+    move = entry->move;
+
+  tt_entry_t new_entry = {
       .eval = eval,
+      .move = move,
+      .depth = depth,
       .node_type = node_type,
+      .generation = cache->tt_generation,
   };
+  new_entry.key = (uint32_t)hash ^ entry_checksum(&new_entry);
+
+  *entry = new_entry;
 }
 
 // Get if the board was saved for memoization before.
+// The move of the board is set to hash_move, even if the evaluation can not be
+// used. MOVE_INV if the board was not saved.
 eval_t try_find_tt(ai_cache_t *cache, hash_t hash, size_t history_size,
-                   size_t depth, eval_t alpha, eval_t beta) {
+                   size_t depth, eval_t alpha, eval_t beta,
+                   move_t *hash_move) {
 
   // Get the transposition table entry for the board.
-  tt_entry_t entry = *get_entry_tt(cache, hash);
-
-  if (entry.hash != hash || entry.eval == EVAL_INVALID || entry.depth < depth) {
+  tt_entry_t entry;
+  if (!find_entry_tt(cache, hash, &entry)) {
+    *hash_move = MOVE_INV;
     return EVAL_INVALID;
   }
 
+  *hash_move = entry.move;
+
+  if (entry.depth < depth)
+    return EVAL_INVALID;
+
   // If the eval is an absolute evaluation, convert the depth absolute as well.
   if (is_mate(entry.eval)) {
     entry.eval -= entry.eval > 0 ? history_size : -history_size;
   }
 
+#ifdef MEASURE_EVAL_COUNT
+  measure_count.tt_probe_counts[entry.node_type]++;
+#endif
+
+  // Bounds are inclusive, so a bound can only be used if it is strictly past
+  // the window. The search would have returned a bound past the window as
+  // well.
   switch (entry.node_type) {
   case EXACT:
     break;
   case LOWER:
-    if (entry.eval > alpha)
+    if (entry.eval <= beta)
       return EVAL_INVALID;
+    break;
   case UPPER:
-    if (entry.eval < beta)
+    if (entry.eval >= alpha)
       return EVAL_INVALID;
+    break;
   }
 
+#ifdef MEASURE_EVAL_COUNT
+  measure_count.tt_hit_counts[entry.node_type]++;
+#endif
+
   return entry.eval;
 }
@@ -20,15 +20,31 @@ JazzInSea. If not, see <https://www.gnu.org/licenses/>.
 #include "ai/cache.h"
 #include "ai/eval_t.h"
 #include "board/hash_t.h"
+#include "move/move_t.h"
 #include "state/history.h"
 
+#include <stdbool.h>
+#include <stddef.h>
+
+// Size of the transposition table in megabytes, if it is not set.
+#define TT_DEFAULT_MEGABYTES 64
+
+// Largest transposition table size in megabytes.
+#define TT_MAX_MEGABYTES ((size_t)1 << 20)
+
 unsigned int get_tt_saved_count();
 unsigned int get_tt_overwritten_count();
 unsigned int get_tt_rewritten_count();
 
-tt_entry_t *get_entry_tt(ai_cache_t *, hash_t);
+bool setup_transposition_table(ai_cache_t *, size_t);
+void clear_transposition_table(ai_cache_t *, size_t);
+void free_transposition_table(ai_cache_t *);
+
+bool find_entry_tt(ai_cache_t *, hash_t, tt_entry_t *);
 
-void try_add_tt(ai_cache_t *, hash_t, size_t, size_t, eval_t, node_type_t);
-eval_t try_find_tt(ai_cache_t *, hash_t, size_t, size_t, eval_t, eval_t);
+void try_add_tt(ai_cache_t *, hash_t, size_t, size_t, eval_t, node_type_t,
+                move_t);
+eval_t try_find_tt(ai_cache_t *, hash_t, size_t, size_t, eval_t, eval_t,
+                   move_t *);
 
 #endif
@@ -16,6 +16,7 @@ JazzInSea. If not, see <https://www.gnu.org/licenses/>.
 
 #include "ai/eval_t.h"
 #include "ai/evaluation.h"
+#include "ai/iterative_deepening.h"
 #include "board/pos_t.h"
 #include "board/status_t.h"
 #include "commands/globals.h"
@@ -40,6 +41,56 @@ JazzInSea. If not, see <https://www.gnu.org/licenses/>.
 #include <time.h>
 #include <unistd.h>
 
+// Search the board with the options of the AI. If the AI is playing the move
+// on a clock, the time of the search is taken from the clock of the side to
+// move and the increment is added to it.
+// If multipv is given, the best root moves are searched exactly as well.
+static eval_t ai_evaluate(move_t *best_moves, multipv_t *multipv,
+                          bool on_clock) {
+  time_limits_t time_limits = fixed_time_limits(global_options.ai_time);
+
+  size_t *clock_ms = game_state.turn ? &global_options.ai_white_time
+                                     : &global_options.ai_black_time;
+  size_t increment_ms = game_state.turn ? global_options.ai_white_increment
+                                        : global_options.ai_black_increment;
+
+  if (global_options.ai_use_clock)
+    time_limits = clock_time_limits(*clock_ms, increment_ms);
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  eval_t eval = evaluate(&game_state, &game_history, global_options.ai_depth,
+                         time_limits, global_options.ai_tt_size,
+                         global_options.ai_threads,
+                         global_options.ai_parallel_mode, multipv, best_moves);
+
+  if (global_options.ai_use_clock && on_clock) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    size_t elapsed_ms = (end.tv_sec - start.tv_sec) * 1000 +
+                        (end.tv_nsec - start.tv_nsec) / 1000000;
+
+    *clock_ms = elapsed_ms < *clock_ms ? *clock_ms - elapsed_ms : 0;
+    *clock_ms += increment_ms;
+  }
+
+  return eval;
+}
+
+// Ponder after the AI played a move, unless the AI plays the opponent as well.
+static void try_start_ponder() {
+  if (!global_options.ai_ponder)
+    return;
+
+  if (game_state.turn ? global_options.white_automove
+                      : global_options.black_automove)
+    return;
+
+  start_ponder(&game_state, &game_history, global_options.ai_depth,
+               global_options.ai_parallel_mode);
+}
+
 void make_automove() {
   // Check if the current player should be automoved.
   if (game_state.turn ? !global_options.white_automove
@@ -63,9 +114,9 @@ void make_automove() {
   pp_f("automove...\n");
 
   move_t best_moves[256];
-  evaluate(&game_state, &game_history, global_options.ai_depth,
-           global_options.ai_time, global_options.ai_tt_size, best_moves);
+  ai_evaluate(best_moves, NULL, true);
   do_move(&game_state, &game_history, random_move(best_moves));
+  try_start_ponder();
 
   io_info();
   pp_f("done automove\n");
@@ -469,9 +520,9 @@ command_define(playai, "Make a random move generated by AI",
   pp_f("playing...\n");
 
   move_t best_moves[256];
-  evaluate(&game_state, &game_history, global_options.ai_depth,
-           global_options.ai_time, global_options.ai_tt_size, best_moves);
+  ai_evaluate(best_moves, NULL, true);
   do_move(&game_state, &game_history, random_move(best_moves));
+  try_start_ponder();
 
   io_info();
   pp_f("done\n");
@@ -525,10 +576,11 @@ end_of_parsing:
   io_info();
   pp_f("evaluating...\n");
 
+  multipv_t multipv = {.count = global_options.ai_multipv};
+
   move_t best_moves[256];
-  eval_t eval =
-      evaluate(&game_state, &game_history, global_options.ai_depth,
-               global_options.ai_time, global_options.ai_tt_size, best_moves);
+  eval_t eval = ai_evaluate(
+      best_moves, global_options.ai_multipv > 1 ? &multipv : NULL, false);
 
   io_info();
   pp_f("evaluating done\n");
@@ -558,12 +610,172 @@ end_of_parsing:
     pp_f(" -> ");
     pp_eval(eval, game_state.board, &game_history);
     pp_f("\n");
+
+    // Print the best root moves with their exact evaluations.
+    if (global_options.ai_multipv > 1) {
+      for (size_t i = 0; i < multipv.count; i++) {
+        pp_f("%zu: ", i + 1);
+        pp_move(multipv.moves[i]);
+        pp_f(" -> ");
+        pp_eval(multipv.evaluations[i], game_state.board, &game_history);
+        pp_f("\n");
+      }
+    }
     break;
   }
 
   return true;
 }
 
+command_define(go, "Start analysing the board in the background",
+               "Usage: go [infinite]\n"
+               "\n"
+               "Start evaluating the board in the background and return right "
+               "away, so other commands can be run during the search. The "
+               "search ends at the search depth of the AI, or earlier if it "
+               "finds a mate. If 'infinite' is given, the search ignores the "
+               "search depth of the AI and runs until 'stop' is run.\n"
+               "The search has no time limit and runs on one thread.\n") {
+
+  size_t max_depth = global_options.ai_depth;
+  bool infinite = false;
+
+  switch (argc) {
+  case 1:
+    break;
+  case 2:
+    if (strcmp(argv[1], "infinite")) {
+      io_error();
+      pp_f("error: expected 'infinite', got '%s'\n", argv[1]);
+      return false;
+    }
+    max_depth = 256;
+    infinite = true;
+    break;
+  default:
+    io_error();
+    pp_f("command 'go' expects 0 or 1 argument.\n");
+    return false;
+  }
+
+  // Check if the game ended.
+  if (game_state.status != NORMAL) {
+    io_error();
+    pp_f("error: game ended\n");
+    return true;
+  }
+
+  set_tt_size(global_options.ai_tt_size);
+  start_analysis(&game_state, &game_history, max_depth, infinite);
+
+  io_info();
+  pp_f("analysing...\n");
+  return true;
+}
+
+command_define(stop, "Stop the analysis started by 'go'",
+               "Usage: stop\n"
+               "\n"
+               "Stop the analysis started by 'go', and print the best moves "
+               "and the evaluation score of the last completed depth.\n") {
+
+  if (argc != 1) {
+    io_error();
+    pp_f("command 'stop' expects no arguments.\n");
+    return false;
+  }
+
+  move_t best_moves[256];
+  eval_t eval;
+  history_t *history = stop_analysis(best_moves, &eval);
+
+  if (!history) {
+    io_error();
+    pp_f("error: no search is running\n");
+    return false;
+  }
+
+  io_info();
+  pp_f("analysing done\n");
+
+  io_basic();
+  pp_moves(best_moves);
+  pp_f(" -> ");
+  pp_eval(eval, game_state.board, history);
+  pp_f("\n");
+  return true;
+}
+
+command_define(isready, "Check if the engine accepts commands",
+               "Usage: isready\n"
+               "\n"
+               "Print 'readyok'. Commands are read during the searches "
+               "started by 'go' as well.\n") {
+
+  if (argc != 1) {
+    io_error();
+    pp_f("command 'isready' expects no arguments.\n");
+    return false;
+  }
+
+  io_basic();
+  pp_f("readyok\n");
+  return true;
+}
+
+command_define(solve, "Find the exact mate distance of the board",
+               "Usage: solve [DEPTH]\n"
+               "\n"
+               "Search for the fastest forced mate on the board, and print the "
+               "moves that lead to it and the exact mate distance.\n"
+               "Uses a depth-first proof-number search. Searches at most "
+               "DEPTH plies if DEPTH is given, otherwise the search depth of "
+               "the AI.\n") {
+
+  size_t max_depth = global_options.ai_depth;
+
+  switch (argc) {
+  case 1:
+    break;
+  case 2:
+    max_depth = atoi(argv[1]);
+    break;
+  default:
+    io_error();
+    pp_f("command 'solve' expects 0 or 1 argument.\n");
+    return false;
+  }
+
+  // Check if the game ended.
+  if (game_state.status != NORMAL) {
+    io_error();
+    pp_f("error: game ended\n");
+    return true;
+  }
+
+  io_info();
+  pp_f("solving...\n");
+
+  move_t best_moves[256];
+  eval_t eval = solve(&game_state, &game_history, max_depth,
+                      global_options.ai_time, best_moves);
+
+  io_info();
+  pp_f("solving done\n");
+
+  io_basic();
+  if (eval == EVAL_INVALID) {
+    pp_f("no mate in %zu plies\n", max_depth);
+    return true;
+  }
+
+  pp_moves(best_moves);
+  pp_f(" -> ");
+  pp_eval(eval, game_state.board, &game_history);
+  pp_f("\n");
+  return true;
+}
+
 command_define(placeat, "Place a piece at a position",
                "Usage: placeat POS PIECE\n"
                "\n"
@@ -662,6 +874,252 @@ command_define(aitime, "Set the maximum allowed search time of the AI",
   }
 }
 
+// Parse a time in milliseconds. Returns false if the text is not a number, or
+// is negative.
+static bool parse_milliseconds(const char *text, size_t *milliseconds) {
+  char *end;
+  long value = strtol(text, &end, 10);
+  if (end == text || *end || value < 0)
+    return false;
+  *milliseconds = value;
+  return true;
+}
+
+command_define(aiclock, "Set the game clocks of the AI",
+               "Usage: aiclock [WTIME BTIME [WINC BINC]]\n"
+               "   or: aiclock off\n"
+               "\n"
+               "Set the time left on the clocks of white and black, and search "
+               "with the time on the clock instead of the time set by "
+               "'aitime'. WINC and BINC are added to the clocks after every "
+               "move the AI plays. Otherwise print the clocks.\n"
+               "All times are in milliseconds.\n") {
+
+  switch (argc) {
+  case 1:
+    io_basic();
+    if (global_options.ai_use_clock) {
+      pp_f("%zu %zu %zu %zu\n", global_options.ai_white_time,
+           global_options.ai_black_time, global_options.ai_white_increment,
+           global_options.ai_black_increment);
+    } else {
+      pp_f("off\n");
+    }
+    return true;
+  case 2:
+    if (strcmp(argv[1], "off")) {
+      io_error();
+      pp_f("error: expected 'off', got '%s'\n", argv[1]);
+      return false;
+    }
+    global_options.ai_use_clock = false;
+    return true;
+  case 3:
+  case 5: {
+    size_t times[4] = {0};
+    for (int i = 1; i < argc; i++) {
+      if (!parse_milliseconds(argv[i], &times[i - 1])) {
+        io_error();
+        pp_f("error: invalid time '%s', expected milliseconds\n", argv[i]);
+        return false;
+      }
+    }
+    global_options.ai_use_clock = true;
+    global_options.ai_white_time = times[0];
+    global_options.ai_black_time = times[1];
+    global_options.ai_white_increment = times[2];
+    global_options.ai_black_increment = times[3];
+    return true;
+  }
+  default:
+    io_error();
+    pp_f("command 'aiclock' expects 0, 1, 2 or 4 arguments.\n");
+    return false;
+  }
+}
+
+command_define(aithreads, "Set the number of search threads of the AI",
+               "Usage: aithreads [COUNT]\n"
+               "\n"
+               "Set the number of threads the AI searches with to COUNT if "
+               "COUNT is given. Otherwise print.\n"
+               "All of the threads share the same transposition table.\n") {
+
+  switch (argc) {
+  case 1:
+    io_basic();
+    pp_f("%zu\n", global_options.ai_threads);
+    return true;
+  case 2: {
+    int threads = atoi(argv[1]);
+    if (threads <= 0) {
+      io_error();
+      pp_f("error: invalid thread count '%s'\n", argv[1]);
+      return false;
+    }
+    global_options.ai_threads = threads;
+    return true;
+  }
+  default:
+    io_error();
+    pp_f("command 'aithreads' expects 0 or 1 argument.\n");
+    return false;
+  }
+}
+
+command_define(hash, "Set the size of the transposition table of the AI",
+               "Usage: hash [MB]\n"
+               "\n"
+               "Set the size of the transposition table to MB megabytes if MB "
+               "is given. Otherwise print.\n"
+               "The table is allocated and cleared right away, so that the "
+               "next search does not wait for it. It is backed by huge pages "
+               "if the system has any.\n") {
+
+  switch (argc) {
+  case 1:
+    io_basic();
+    pp_f("%zu\n", global_options.ai_tt_size);
+    return true;
+  case 2: {
+    int megabytes = atoi(argv[1]);
+    if (megabytes <= 0 || (size_t)megabytes > TT_MAX_MEGABYTES) {
+      io_error();
+      pp_f("error: invalid size '%s', expected 1 to %zu\n", argv[1],
+           TT_MAX_MEGABYTES);
+      return false;
+    }
+    if (!set_tt_size(megabytes)) {
+      io_error();
+      pp_f("error: could not allocate a %d MB transposition table\n",
+           megabytes);
+      return false;
+    }
+    global_options.ai_tt_size = megabytes;
+    return true;
+  }
+  default:
+    io_error();
+    pp_f("command 'hash' expects 0 or 1 argument.\n");
+    return false;
+  }
+}
+
+command_define(aimultipv, "Set the number of root moves the AI evaluates",
+               "Usage: aimultipv [COUNT]\n"
+               "\n"
+               "Set the number of best root moves that 'evaluate' prints with "
+               "their exact evaluation to COUNT if COUNT is given. Otherwise "
+               "print.\n"
+               "The other root moves are only searched to prove that they are "
+               "worse than these moves, so the search takes far less time "
+               "than COUNT searches. Not used by the Monte Carlo tree search "
+               "and pondering.\n") {
+
+  switch (argc) {
+  case 1:
+    io_basic();
+    pp_f("%zu\n", global_options.ai_multipv);
+    return true;
+  case 2: {
+    int count = atoi(argv[1]);
+    if (count <= 0 || count > MULTIPV_MAX) {
+      io_error();
+      pp_f("error: invalid move count '%s', expected 1 to %d\n", argv[1],
+           MULTIPV_MAX);
+      return false;
+    }
+    global_options.ai_multipv = count;
+    return true;
+  }
+  default:
+    io_error();
+    pp_f("command 'aimultipv' expects 0 or 1 argument.\n");
+    return false;
+  }
+}
+
+command_define(aiponder, "Set if the AI searches on the opponent's time",
+               "Usage: aiponder [on|off]\n"
+               "\n"
+               "Set pondering on or off if given. Otherwise print.\n"
+               "When pondering is on, the AI keeps searching after playing a "
+               "move, on the position after the reply it expects. If the "
+               "opponent plays that reply, the search continues from where "
+               "it was.\n") {
+
+  switch (argc) {
+  case 1:
+    io_basic();
+    pp_f("%s\n", global_options.ai_ponder ? "on" : "off");
+    return true;
+  case 2:
+    if (!strcmp(argv[1], "on")) {
+      global_options.ai_ponder = true;
+    } else if (!strcmp(argv[1], "off")) {
+      global_options.ai_ponder = false;
+      stop_ponder();
+    } else {
+      io_error();
+      pp_f("error: expected 'on' or 'off', got '%s'\n", argv[1]);
+      return false;
+    }
+    return true;
+  default:
+    io_error();
+    pp_f("command 'aiponder' expects 0 or 1 argument.\n");
+    return false;
+  }
+}
+
+command_define(aiparallel, "Set how the AI splits the search between threads",
+               "Usage: aiparallel [MODE]\n"
+               "\n"
+               "Set the parallel search mode of the AI to MODE if MODE is "
+               "given. Otherwise print.\n"
+               "\n"
+               "  lazy          Every thread runs its own search, sharing the "
+               "transposition table\n"
+               "  split         Threads search the remaining moves of a node "
+               "after its first move\n"
+               "  mcts          Threads run Monte Carlo tree search on a shared "
+               "tree\n") {
+
+  switch (argc) {
+  case 1:
+    io_basic();
+    switch (global_options.ai_parallel_mode) {
+    case PARALLEL_LAZY:
+      pp_f("lazy\n");
+      break;
+    case PARALLEL_SPLIT:
+      pp_f("split\n");
+      break;
+    case PARALLEL_MCTS:
+      pp_f("mcts\n");
+      break;
+    }
+    return true;
+  case 2:
+    if (!strcmp(argv[1], "lazy")) {
+      global_options.ai_parallel_mode = PARALLEL_LAZY;
+    } else if (!strcmp(argv[1], "split")) {
+      global_options.ai_parallel_mode = PARALLEL_SPLIT;
+    } else if (!strcmp(argv[1], "mcts")) {
+      global_options.ai_parallel_mode = PARALLEL_MCTS;
+    } else {
+      io_error();
+      pp_f("error: unknown parallel mode '%s'\n", argv[1]);
+      return false;
+    }
+    return true;
+  default:
+    io_error();
+    pp_f("command 'aiparallel' expects 0 or 1 argument.\n");
+    return false;
+  }
+}
+
 static inline size_t count_branches(size_t depth) {
   if (!depth)
     return 1;
@@ -722,10 +1180,9 @@ bool wait_for_child_resp(pid_t pid, char buffer[256], FILE *child_stdout) {
     return true;
   }
 
-  int status;
-  waitpid(pid, &status, WNOHANG);
-
-  return status && WIFEXITED(status);
+  // The status is only set if the child changed state.
+  int status = 0;
+  return waitpid(pid, &status, WNOHANG) == pid && WIFEXITED(status);
 }
 
 command_define(
@@ -896,9 +1353,7 @@ command_define(
           if (game_state.turn) {
             // If it is our turn to play, generate a random best move.
             move_t best_moves[256];
-            evaluate(&game_state, &game_history, global_options.ai_depth,
-                     global_options.ai_time, global_options.ai_tt_size,
-                     best_moves);
+            ai_evaluate(best_moves, NULL, true);
             move = random_move(best_moves);
 
           } else {
@@ -931,11 +1386,17 @@ command_define(
           fprint_move(child_stdin, move);
           fprintf(child_stdin, "\n");
           fflush(child_stdin);
+
+          // Ponder while the child is searching.
+          if (!game_state.turn && global_options.ai_ponder)
+            start_ponder(&game_state, &game_history, global_options.ai_depth,
+                         global_options.ai_parallel_mode);
         }
 
-        int status;
-        waitpid(pid, &status, WNOHANG);
-        if (WIFEXITED(status)) {
+        stop_ponder();
+
+        int status = 0;
+        if (waitpid(pid, &status, WNOHANG) == pid && WIFEXITED(status)) {
           pp_f("process exited with exit code %u\n", WEXITSTATUS(status));
         } else {
           kill(pid, SIGKILL);
@@ -1033,8 +1494,18 @@ command_entry_t command_entries[] = {
     command_entry(removeat),
     command_entry(aidepth),
     command_entry(aitime),
+    command_entry(aiclock),
+    command_entry(aithreads),
+    command_entry(hash),
+    command_entry(aiparallel),
+    command_entry(aiponder),
+    command_entry(aimultipv),
     command_entry(playai),
     command_entry(evaluate),
+    command_entry(solve),
+    command_entry(go),
+    command_entry(stop),
+    command_entry(isready),
     command_entry(test),
     {
         NULL,
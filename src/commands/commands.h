@@ -39,10 +39,20 @@ command_declare(descmove);
 command_declare(automove);
 command_declare(playai);
 command_declare(evaluate);
+command_declare(solve);
+command_declare(go);
+command_declare(stop);
+command_declare(isready);
 command_declare(placeat);
 command_declare(removeat);
 command_declare(aidepth);
 command_declare(aitime);
+command_declare(aiclock);
+command_declare(aithreads);
+command_declare(hash);
+command_declare(aiparallel);
+command_declare(aiponder);
+command_declare(aimultipv);
 command_declare(test);
 command_declare(help);
 
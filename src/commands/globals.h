@@ -17,6 +17,7 @@ JazzInSea. If not, see <https://www.gnu.org/licenses/>.
 #ifndef _COMMANDS_GLOBALS_H
 #define _COMMANDS_GLOBALS_H
 
+#include "ai/split_point.h"
 #include "commands/commands.h"
 #include "state/board_state_t.h"
 #include "state/history.h"
@@ -31,7 +32,20 @@ typedef struct {
 
   struct timespec ai_time;
   size_t ai_depth;
+
+  // Size of the transposition table in megabytes.
   size_t ai_tt_size;
+  size_t ai_threads;
+  parallel_mode_t ai_parallel_mode;
+  bool ai_ponder;
+  size_t ai_multipv;
+
+  // Clocks in milliseconds, used instead of ai_time if ai_use_clock is set.
+  bool ai_use_clock;
+  size_t ai_white_time;
+  size_t ai_black_time;
+  size_t ai_white_increment;
+  size_t ai_black_increment;
 
   bool white_automove;
   bool black_automove;
@@ -45,6 +45,8 @@ void print_help_message(const char *executable) {
        "\n"
        "    -h          Show this message\n"
        "    -r          Set the random seed to 0\n"
+       "    -H MB       Set the size of the transposition table to MB "
+       "megabytes\n"
        "    -s          Do not print 'info' messages\n"
        "    -n          Do not accept commands via stdin (do not start "
        "interactive mode), only command line\n"
@@ -57,7 +59,7 @@ void print_help_message(const char *executable) {
 
 void parse_command_line_args(int argc, char **argv) {
   const char *executable = argv[0];
-  const char *global_opts = "hrnsi:d:";
+  const char *global_opts = "hrnsi:d:H:";
 
   while (true) {
     char c = getopt(argc, argv, global_opts);
@@ -81,6 +83,17 @@ void parse_command_line_args(int argc, char **argv) {
       global_options.file_info = fopen("/dev/null", "w");
       break;
 
+    case 'H': {
+      int megabytes = atoi(optarg);
+      if (megabytes <= 0 || (size_t)megabytes > TT_MAX_MEGABYTES) {
+        io_error();
+        pp_f("error: invalid transposition table size '%s'\n", optarg);
+        exit(1);
+      }
+      global_options.ai_tt_size = megabytes;
+      break;
+    }
+
     case 'n':
       global_options.accept_stdin = false;
       break;
@@ -149,8 +162,13 @@ void initialize(int argc, char **argv) {
       .executable = argv[0],
       .accept_stdin = true,
 
-      .ai_tt_size = 0x20000,
+      .ai_tt_size = TT_DEFAULT_MEGABYTES,
       .ai_depth = 256,
+      .ai_threads = 1,
+      .ai_parallel_mode = PARALLEL_LAZY,
+      .ai_ponder = false,
+      .ai_multipv = 1,
+      .ai_use_clock = false,
       .ai_time.tv_nsec = 0,
       .ai_time.tv_sec = 2,
 
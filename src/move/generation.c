@@ -38,11 +38,13 @@ static inline bool sum_inrange(pos_t pos, int delta) {
   return 0 <= row + drow && row + drow < 8 && 0 <= col + dcol && col + dcol < 8;
 }
 
-// Generate all possible moves on the board, and place them on the moves array.
+// Generate the moves on the board, and place them on the moves array.
+// If captures_only is set, regular moves are not generated.
 // Moves array is terminated by adding a MOVE_INV.
-void generate_moves(board_state_t *state, move_t moves[256]) {
+static inline void _generate_moves(board_state_t *state, move_t moves[256],
+                                   bool captures_only) {
 #ifdef MEASURE_EVAL_COUNT
-  move_generation_count++;
+  measure_count.move_generation_count++;
 #endif
 
   if (state->status != NORMAL) {
@@ -122,7 +124,7 @@ void generate_moves(board_state_t *state, move_t moves[256]) {
         // The destination position is empty.
         // If there are any available captures, no need to try to find a
         // regular move.
-        if (capture_available)
+        if (capture_available || captures_only)
           continue;
 
         // Set the move object.
@@ -136,3 +138,15 @@ void generate_moves(board_state_t *state, move_t moves[256]) {
   }
   moves[length] = MOVE_INV;
 }
+
+// Generate all possible moves on the board, and place them on the moves array.
+// Moves array is terminated by adding a MOVE_INV.
+void generate_moves(board_state_t *state, move_t moves[256]) {
+  _generate_moves(state, moves, false);
+}
+
+// Generate only the capture moves on the board. Since captures are mandatory,
+// if there are any captures these are all of the available moves.
+void generate_captures(board_state_t *state, move_t moves[256]) {
+  _generate_moves(state, moves, true);
+}
@@ -23,5 +23,6 @@ JazzInSea. If not, see <https://www.gnu.org/licenses/>.
 #include <stddef.h>
 
 void generate_moves(board_state_t *, move_t[256]);
+void generate_captures(board_state_t *, move_t[256]);
 
 #endif
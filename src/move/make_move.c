@@ -232,3 +232,27 @@ bool undo_last_move(board_state_t *state, history_t *history) {
 
   return update_islands_table;
 }
+
+// Pass the turn to the opponent without moving any pieces.
+// A MOVE_INV is added to the history, so that the history still has one item
+// for each ply.
+void do_null_move(board_state_t *state, history_t *history) {
+  history->history[history->size++] = (history_item_t){
+      .move = MOVE_INV,
+      .hash = state->hash,
+  };
+
+  state->turn = !state->turn;
+  state->hash ^= state->turn_hash;
+}
+
+// Undo a null move made by do_null_move.
+void undo_null_move(board_state_t *state, history_t *history) {
+  assert(history->size > 0);
+  assert(!is_valid_move(history->history[history->size - 1].move));
+
+  history->size--;
+
+  state->turn = !state->turn;
+  state->hash ^= state->turn_hash;
+}
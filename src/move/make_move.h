@@ -26,4 +26,7 @@ bool remove_piece(board_state_t *, history_t *, pos_t);
 bool do_move(board_state_t *, history_t *, move_t);
 bool undo_last_move(board_state_t *, history_t *);
 
+void do_null_move(board_state_t *, history_t *);
+void undo_null_move(board_state_t *, history_t *);
+
 #endif
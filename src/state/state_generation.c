@@ -70,13 +70,20 @@ void generate_islands(board_state_t *state) {
   assert(state->black_island_count <= state->black_count);
 }
 
+// Return a random hash with all of its 64 bits set randomly. rand only
+// returns 31 random bits, and the high bits of the hashes select the
+// transposition table bucket.
+static inline hash_t _random_hash() {
+  return (hash_t)rand() << 62 ^ (hash_t)rand() << 31 ^ (hash_t)rand();
+}
+
 // Generate the square hashes table.
 static inline void _generate_hash_tables(board_state_t *state) {
-  state->turn_hash = (long)rand() << 32 | rand();
+  state->turn_hash = _random_hash();
 
   for (pos_t position = 0; position < 64; position++) {
     for (int piece = 0; piece < 4; piece++) {
-      state->hash_tables[piece][position] = (long)rand() << 32 | rand();
+      state->hash_tables[piece][position] = _random_hash();
     }
   }
 }